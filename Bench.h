@@ -0,0 +1,240 @@
+#ifndef __BENCH__
+#define __BENCH__
+/*
+ * Deterministic replay benchmark for the alarm clock.
+ *
+ * When the sketch is compiled with WECKER_BENCH defined, loop() does not run
+ * on wall-clock time anymore. Instead a simulated clock is advanced by a fixed
+ * step per loop iteration and the clock, LED and card logic is fed from a
+ * scripted scenario. The firmware code itself stays unchanged, so the numbers
+ * show what a change costs on the real board.
+ *
+ * Output is written to Serial as CSV (one line per simulated hour plus a
+ * summary line), so two runs can simply be diffed:
+ *
+ *   bench,scenario,hour,cpu_us,loops,frames,missed,frame_us,over,i2c,spi,uart,minfree
+ *
+ * frame_us is the longest time a single NeoPattern::Update() took, over the
+ * number of frames that exceeded BENCH_FRAME_BUDGET. minfree is the stack
+ * high-water mark of the hour (see MemStats::stackHeadroom()).
+ *
+ * BENCH_WALL first sweeps the wall strip over growing pixel counts and
+ * prints one line per count, RAM of the palette frame next to a plain RGB
+ * buffer and the time show() needs for that many pixels (timed with timer1,
+ * micros() stops while show() has interrupts off):
+ *
+ *   wall,bits,pixels,ram,rgb_ram,show_us
+ *
+ * The staged boot in the sketch adds "boot,display_ms,<ms>" and
+ * "boot,ready_ms,<ms>" once the clock is shown and all peripherals are up.
+ *
+ * Bus counters are estimates: the drivers are not instrumented, so the
+ * callers add the number of bytes a transaction puts on the wire.
+ */
+#include <Arduino.h>
+#include "RTClib.h"
+#include "MemStats.h"
+
+// Scripted scenarios
+enum BenchScenario : byte {
+  BENCH_NIGHT     = 0x00,  // 23:30 - 07:30, alarm 07:00 with 30 min sunrise
+  BENCH_CARDSTORM = 0x01,  // one hour, 100 card swipes per minute
+  BENCH_RAINBOW   = 0x02,  // one hour, rainbow cycle with 300 ms interval
+  BENCH_SUNRISE   = 0x03,  // one hour, starting with a dithered 30 min sunrise
+  BENCH_PIXEL     = 0x04,  // one hour, sun arc / comet / breathing for 20 min each
+  BENCH_WALL      = 0x05   // one hour, 30 min sunrise on the wall strip (needs WECKER_WALL)
+};
+
+#define BENCH_STEP        20   // ms of simulated time per loop iteration
+#define BENCH_FRAME_BUDGET 2000  // us a single frame may take (24 LEDs need 720 us for show())
+
+// estimated bytes on the wire per transaction
+#define BENCH_I2C_RTC_READ     10   // address + register, address + 7 data bytes
+#define BENCH_I2C_OLED_TILE    14   // 8 data bytes + addressing commands per 8x8 tile
+#define BENCH_SPI_CARD_POLL    16   // PICC_IsNewCardPresent (REQA, no answer)
+#define BENCH_SPI_CARD_READ   120   // select, authenticate, read block, halt
+#define BENCH_UART_MP3_CMD     10   // one DFPlayer frame
+#define BENCH_UART_MP3_QUERY   20   // DFPlayer frame + reply
+
+#ifdef WECKER_BENCH
+  #define BENCH_COUNT(counter, n) (bench.counter += (n))
+#else
+  #define BENCH_COUNT(counter, n)
+#endif
+
+class Bench {
+  public:
+  BenchScenario scenario;
+  unsigned long stepMillis;   // simulated time per loop iteration
+  unsigned long simMillis;    // simulated time since start of scenario
+  unsigned long endMillis;    // length of the scenario
+  DateTime start;             // wall clock time at simMillis == 0
+
+  // counters for the current simulated hour
+  uint32_t cpuMicros;
+  uint32_t loops;
+  uint32_t frames;
+  uint32_t missedFrames;
+  uint32_t maxFrameMicros;
+  uint32_t overBudget;
+  uint32_t i2cBytes;
+  uint32_t spiBytes;
+  uint32_t uartBytes;
+  uint16_t minFree;           // lowest free RAM between heap and stack in the last hour
+
+  // counters over the whole run
+  uint32_t totalCpuMicros;
+  uint32_t totalMissedFrames;
+
+  private:
+  unsigned long workStart;
+  unsigned long nextCard;
+  uint8_t hour;
+  boolean finished;
+
+  public:
+  Bench() : scenario(BENCH_NIGHT), stepMillis(BENCH_STEP), simMillis(0), endMillis(0), finished(true) {}
+
+  void begin(BenchScenario sc, unsigned long step) {
+    scenario = sc;
+    stepMillis = step;
+    simMillis = 0;
+    hour = 0;
+    nextCard = 0;
+    totalCpuMicros = 0;
+    totalMissedFrames = 0;
+    finished = false;
+    resetCounters();
+
+    switch (scenario) {
+      case BENCH_NIGHT:
+        start = DateTime(2019, 9, 24, 23, 30, 0);
+        endMillis = 8UL * 3600000UL;
+        break;
+      case BENCH_CARDSTORM:
+      case BENCH_RAINBOW:
+      case BENCH_SUNRISE:
+      case BENCH_PIXEL:
+      case BENCH_WALL:
+      default:
+        start = DateTime(2019, 9, 24, 12, 0, 0);
+        endMillis = 3600000UL;
+        break;
+    }
+    Serial.println(F("bench,scenario,hour,cpu_us,loops,frames,missed,frame_us,over,i2c,spi,uart,minfree"));
+  }
+
+  // simulated replacements for millis() and rtc.now()
+  unsigned long millis() {
+    return simMillis;
+  }
+  DateTime now() {
+    return start + TimeSpan((int32_t)(simMillis / 1000));
+  }
+
+  boolean done() {
+    return finished;
+  }
+
+  // returns true if the scenario wants a card swipe in this iteration
+  boolean cardDue() {
+    if (simMillis < nextCard) return false;
+    switch (scenario) {
+      case BENCH_CARDSTORM:
+        nextCard += 600;       // 100 swipes per minute
+        return true;
+      case BENCH_PIXEL:
+        nextCard += 1200000;   // next pattern every 20 minutes
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  // measure the processing time of one loop iteration
+  void beginWork() {
+    workStart = micros();
+  }
+  void endWork() {
+    cpuMicros += micros() - workStart;
+    loops++;
+  }
+
+  // called with the pattern state before NeoPattern::Update(): a frame is
+  // missed if it was already due in the previous loop iteration; the first
+  // frame of a new pattern is never late
+  void checkFrame(unsigned long lastUpdate, unsigned long interval, boolean running) {
+    if (!running) return;
+    if (simMillis - lastUpdate >= interval + stepMillis) missedFrames++;
+  }
+  void countFrame(unsigned long lastUpdateBefore, unsigned long lastUpdateAfter, uint32_t frameMicros) {
+    if (lastUpdateBefore == lastUpdateAfter) return;
+    frames++;
+    if (frameMicros > maxFrameMicros) maxFrameMicros = frameMicros;
+    if (frameMicros > BENCH_FRAME_BUDGET) overBudget++;
+  }
+
+  // advance simulated time, report every full simulated hour
+  void step() {
+    simMillis += stepMillis;
+    if (simMillis / 3600000UL != hour) {
+      report();
+      hour = simMillis / 3600000UL;
+      resetCounters();
+    }
+    if (simMillis >= endMillis) {
+      finished = true;
+      Serial.print(F("bench,"));
+      Serial.print(scenario);
+      Serial.print(F(",total,"));
+      Serial.print(totalCpuMicros);
+      Serial.print(F(",,,"));
+      Serial.println(totalMissedFrames);
+    }
+  }
+
+  private:
+  void resetCounters() {
+    cpuMicros = loops = frames = missedFrames = maxFrameMicros = overBudget = 0;
+    i2cBytes = spiBytes = uartBytes = 0;
+  }
+
+  void report() {
+    // stack high-water mark of this hour: canary bytes left untouched since
+    // the last paint, so the deepest call (ISRs included) counts, not just
+    // the stack depth between two loop iterations
+    minFree = MemStats::stackHeadroom();
+    MemStats::paint();
+    totalCpuMicros += cpuMicros;
+    totalMissedFrames += missedFrames;
+    Serial.print(F("bench,"));
+    Serial.print(scenario);
+    Serial.print(',');
+    Serial.print(hour);
+    Serial.print(',');
+    Serial.print(cpuMicros);
+    Serial.print(',');
+    Serial.print(loops);
+    Serial.print(',');
+    Serial.print(frames);
+    Serial.print(',');
+    Serial.print(missedFrames);
+    Serial.print(',');
+    Serial.print(maxFrameMicros);
+    Serial.print(',');
+    Serial.print(overBudget);
+    Serial.print(',');
+    Serial.print(i2cBytes);
+    Serial.print(',');
+    Serial.print(spiBytes);
+    Serial.print(',');
+    Serial.print(uartBytes);
+    Serial.print(',');
+    Serial.println(minFree);
+  }
+};
+
+#ifdef WECKER_BENCH
+extern Bench bench;
+#endif
+#endif
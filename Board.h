@@ -0,0 +1,47 @@
+#ifndef __BOARD__
+#define __BOARD__
+/*
+ * Hardware configuration of the alarm clock.
+ *
+ * Clock, NeoPattern and Cardreader are templates on one of these structs, so
+ * pins, LED count and card layout are compile-time constants, pixel loops get
+ * constant bounds and only the configured display driver is linked.
+ */
+#include <Arduino.h>
+#include <U8x8lib.h>
+#include <Adafruit_NeoPixel.h>
+
+// Arduino Uno with the 1.3" display (see wiring_diagram.png)
+struct WeckerBoard {
+  // RFID (SPI)
+  static const byte RST_PIN = 9;
+  static const byte SS_PIN = 10;
+  static const byte CARD_SECTOR = 1;
+  static const byte CARD_BLOCK = 4;
+  static const byte CARD_TRAILER = 7;
+
+  // MP3
+  static const byte MP3_RX_PIN = 2;
+  static const byte MP3_TX_PIN = 3;
+  static const byte MP3_BUSY_PIN = 4;
+
+  // LED ring
+  static const byte LED_PIN = 8;
+  static const uint16_t LED_COUNT = 24;
+  static const neoPixelType LED_TYPE = NEO_GRB + NEO_KHZ800;
+
+  // optional LED strip on the wall (WECKER_WALL), see PaletteStrip.h
+  static const byte WALL_PIN = 6;
+  static const uint16_t WALL_COUNT = 150;
+  static const neoPixelType WALL_TYPE = NEO_GRB + NEO_KHZ800;
+
+  // OLED and RTC share the I2C bus, both allow fast mode
+  typedef U8X8_SH1106_128X64_NONAME_HW_I2C Display;     // bigger display 1.33
+  static const uint32_t I2C_CLOCK = 400000;
+};
+
+// same board with the small 0.96" display
+struct WeckerBoardSmallDisplay : WeckerBoard {
+  typedef U8X8_SSD1306_128X64_NONAME_HW_I2C Display;
+};
+#endif
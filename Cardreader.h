@@ -23,6 +23,7 @@
 #include <Arduino.h>
 #include <SPI.h>
 #include <MFRC522.h>
+#include "Board.h"
 
 enum WAKEUPMODE : byte {
     WKMOD_OFF       = 0x00,
@@ -42,9 +43,14 @@ enum WAKEUPMODE : byte {
     PAT_RAINBOW   = 0x04,
     PAT_MOOD_RND  = 0x05,
     PAT_MOOD_COL  = 0x06,
+    PAT_SUNARC    = 0x07,
+    PAT_COMET     = 0x08,
+    PAT_BREATHE   = 0x09,
     PAT_UNCHANGED = 0x63
   };
   
+// card reader, pins and the sector/block used on the card come from the Board configuration
+template <class Board>
 class Cardreader : public MFRC522 {
   public:
 
@@ -62,25 +68,42 @@ class Cardreader : public MFRC522 {
     uint8_t light_b;
   };
   nfcTagObject myCard;
+  boolean present;     // reader answered in begin()
 
   private:
     MIFARE_Key key;
     bool successRead;
-    byte sector;
-    byte blockAddr;
-    byte trailerBlock;
+    static const byte sector = Board::CARD_SECTOR;
+    static const byte blockAddr = Board::CARD_BLOCK;
+    static const byte trailerBlock = Board::CARD_TRAILER;
     StatusCode status;
   
   public:
 
-  Cardreader (byte chipSelectPin, byte resetPowerDownPin, byte sector = 1, byte blockAddr = 4, byte trailerBlock = 7)
-  : MFRC522(chipSelectPin, resetPowerDownPin),
-  sector (sector), blockAddr(blockAddr), trailerBlock(trailerBlock)
+  Cardreader ()
+  : MFRC522(Board::SS_PIN, Board::RST_PIN)
   {
     for (byte i = 0; i < 6; i++) key.keyByte[i] = 0xFF;
+    present = false;
+    status = STATUS_OK;
+  }
+
+  // result of the last authenticate / read / write on a card
+  StatusCode lastStatus() {
+    return status;
+  }
+
+  // initialise the reader, returns false if it does not answer
+  boolean begin() {
+    PCD_Init();
+    byte version = PCD_ReadRegister(VersionReg);
+    present = (version != 0x00 && version != 0xFF);   // no answer on SPI
+    Serial.print(F("MFRC522 Firmware Version: 0x"));
+    Serial.println(version, HEX);
+    return present;
   }
   
-  uint8_t readSerial(int maxZahl, String text) {
+  uint8_t readSerial(int maxZahl, const __FlashStringHelper *text) {
     byte buffer[34];
     byte len;
     int zahl;
@@ -158,7 +181,7 @@ class Cardreader : public MFRC522 {
       returnValue = false;
       Serial.print(F("PCD_Authenticate() failed: "));
       Serial.println(GetStatusCodeName(status));
-      return;
+      return false;
     }
   
     /*// Show the whole sector as it currently is
@@ -213,17 +236,17 @@ class Cardreader : public MFRC522 {
     Serial.println(F("Neue Karte konfigurieren"));
   
     // read in data  
-    myCard.wakeup_mode = readSerial(99, "New status of alarm clock:   (0 = inactive, 1 = active, 99 = unchanged)  ---> end with #");
+    myCard.wakeup_mode = readSerial(99, F("New status of alarm clock:   (0 = inactive, 1 = active, 99 = unchanged)  ---> end with #"));
     Serial.println(myCard.wakeup_mode);
   
     if (myCard.wakeup_mode == 1) {
-      myCard.wakeup_sound = readSerial(99, "Alarm sound:   (0 = inactive, 1 = active, 99 = unchanged)  ---> end with #");
+      myCard.wakeup_sound = readSerial(99, F("Alarm sound:   (0 = inactive, 1 = active, 99 = unchanged)  ---> end with #"));
       Serial.println(myCard.wakeup_sound);
   
-      myCard.wakeup_hours = readSerial(99, "Alarm time (hours):   (0 - 23, 99 = unchanged)  ---> end with #");
+      myCard.wakeup_hours = readSerial(99, F("Alarm time (hours):   (0 - 23, 99 = unchanged)  ---> end with #"));
       Serial.println(myCard.wakeup_hours);
   
-      myCard.wakeup_minutes = readSerial(99, "Alarm time (minutes):   (0 - 59)  ---> end with #");
+      myCard.wakeup_minutes = readSerial(99, F("Alarm time (minutes):   (0 - 59)  ---> end with #"));
       Serial.println(myCard.wakeup_minutes);
     } else {
       myCard.wakeup_sound = 99;
@@ -231,13 +254,13 @@ class Cardreader : public MFRC522 {
       myCard.wakeup_minutes = 99;
     }
   
-    myCard.light_pattern = readSerial(99, "Light pattern:   \n\t(0 - off, 1 - sunrise, 2 - sundown, \n\t3 - sundown with sleep light, \n\t4 - rainbow, 5 - moodlight random, \n\t6 - moodlight color, 99 - unchanged)  ---> end with #");
+    myCard.light_pattern = readSerial(99, F("Light pattern:   \n\t(0 - off, 1 - sunrise, 2 - sundown, \n\t3 - sundown with sleep light, \n\t4 - rainbow, 5 - moodlight random, \n\t6 - moodlight color, 7 - sun arc, \n\t8 - comet, 9 - breathing, 99 - unchanged)  ---> end with #"));
     Serial.println(myCard.light_pattern);
   
-    if (myCard.light_pattern == 6) {
-      myCard.light_r = readSerial(255, "Light color (red):   (0 - 255)  ---> end with #");
-      myCard.light_g = readSerial(255, "Light color (green):   (0 - 255)  ---> end with #");
-      myCard.light_b = readSerial(255, "Light color (blue):   (0 - 255)  ---> end with #");
+    if (myCard.light_pattern == PAT_MOOD_COL || myCard.light_pattern == PAT_COMET || myCard.light_pattern == PAT_BREATHE) {
+      myCard.light_r = readSerial(255, F("Light color (red):   (0 - 255)  ---> end with #"));
+      myCard.light_g = readSerial(255, F("Light color (green):   (0 - 255)  ---> end with #"));
+      myCard.light_b = readSerial(255, F("Light color (blue):   (0 - 255)  ---> end with #"));
     } else {
       myCard.light_r = 99;
       myCard.light_g = 99;
@@ -5,17 +5,74 @@
 #include <Wire.h>     // I2C
 #include <U8x8lib.h>
 #include "RTClib.h"
+#include "Bench.h"
+#include "Board.h"
+#include "I2cBus.h"
 
-static const char *weekday[] = {"So", "Mo", "Di", "Mi", "Do", "Fr", "Sa"};
+static const char weekdays[] PROGMEM = "SoMoDiMiDoFrSa";   // two characters per day, kept in flash
 
+// parts of the display that are drawn separately, see drawSlice()
+enum ClockSlice : byte {
+  SLICE_DATE_LEFT = 0,   // "Mo, 11."
+  SLICE_DATE_RIGHT,      // "02.2019"
+  SLICE_HOUR10,          // 2x4 tiles per character
+  SLICE_HOUR1,
+  SLICE_COLON,
+  SLICE_MIN10,
+  SLICE_MIN1,
+  SLICE_ALARM_ICON,
+  SLICE_ALARM_TIME,
+  SLICE_STAR,
+  SLICE_SUN,
+  SLICE_COUNT
+};
+#define SLICE_ALL ((1 << SLICE_COUNT) - 1)
+static constexpr uint8_t sliceTiles[SLICE_COUNT] PROGMEM = { 7, 7, 8, 8, 8, 8, 8, 4, 5, 4, 4 };
+
+// tiles of the largest slice, a slice is drawn in one loop() iteration
+constexpr uint8_t largestSlice(uint8_t i = 0, uint8_t most = 0) {
+  return (i == SLICE_COUNT) ? most : largestSlice(i + 1, (sliceTiles[i] > most) ? sliceTiles[i] : most);
+}
+static_assert(largestSlice() <= I2C_SLICE_TILES, "a display slice is larger than I2C_SLICE_TILES");
+
+// Display power policy, tied to the alarm timeline: dimmed from bedtime,
+// off from deep night until the sunrise starts (alarm 0). A card swipe wakes
+// the display (dimmed) for DISPLAY_WAKE_SECS.
+enum DisplayMode : byte {
+  DISPLAY_DAY = 0,
+  DISPLAY_DIM,
+  DISPLAY_OFF
+};
+#define DISPLAY_CONTRAST_DAY 255
+#define DISPLAY_CONTRAST_DIM 8
+#define DISPLAY_WAKE_SECS    20
+
+// where the current time is in the alarm timeline
+enum AlarmPhase : byte {
+  PHASE_UNKNOWN,   // not evaluated since the reset
+  PHASE_IDLE,
+  PHASE_SUNRISE,   // alarm 0 - alarm 1
+  PHASE_RING       // alarm 1 - alarm 2
+};
+
+template <class Board>
 class Clock {
   protected:
-  U8X8 u8x8;
+  typename Board::Display u8x8;   // only the driver of the configured display is linked
   RTC_DS3231 rtc;
   boolean syncOnFirstStart;
   uint8_t lastShownMinute;
   boolean showSun;
   boolean showStar;
+  boolean rtcPresent;
+  AlarmPhase phase;
+  uint16_t secsInPhase;
+  DateTime shown;       // time on the display
+  uint16_t dirty;       // ClockSlice bits that still have to be drawn
+  DisplayMode displayMode;
+  boolean wakeRequested;  // card swipe, display on from the next update
+  boolean awake;          // display on until wakeEnd
+  uint32_t wakeEnd;       // second of the day
 
   public:
   uint8_t alarm0hour; // needed to switch of alarm after 30 minutes
@@ -26,17 +83,16 @@ class Clock {
   uint8_t alarm2min;
   boolean alarm;
   boolean alarmMusic;
+  uint8_t bedHour;    // display dimmed from here
+  uint8_t bedMin;
+  uint8_t nightHour;  // display off from here until alarm 0
+  uint8_t nightMin;
   void (*OnAlarm1)();  // Callback for alarm 1
   void (*OnAlarm2)();  // Callback for alarm 2
   void (*OnAlarm0)();  // Callback for alarm 0
 
   // constructor
-  Clock(byte oledtype, boolean sync, void (*callback0)(), void (*callback1)(), void (*callback2)()) {
-    if (oledtype == 0)
-      u8x8 = U8X8_SSD1306_128X64_NONAME_HW_I2C(/* reset=*/ U8X8_PIN_NONE);    // small display 0.96
-    else
-      u8x8 = U8X8_SH1106_128X64_NONAME_HW_I2C(/* reset=*/ U8X8_PIN_NONE);      // bigger display 1.33
-
+  Clock(boolean sync, void (*callback0)(), void (*callback1)(), void (*callback2)()) {
     syncOnFirstStart = sync;
     // alarm 7:00, with 30mins before and after
     alarm1hour = alarm2hour = 7;
@@ -45,6 +101,16 @@ class Clock {
     alarm2min = alarm0min = 30;
     
     lastShownMinute = 60;       // offset > 59 for beginning
+    rtcPresent = false;
+    phase = PHASE_UNKNOWN;
+    secsInPhase = 0;
+    dirty = SLICE_ALL;
+    displayMode = DISPLAY_DAY;
+    wakeRequested = awake = false;
+    bedHour = 19;
+    bedMin = 0;
+    nightHour = 20;
+    nightMin = 30;
     alarm = false;
     showSun = false;
     showStar = false;
@@ -54,54 +120,121 @@ class Clock {
     OnAlarm2 = callback2;
     OnAlarm0 = callback0;
   }
+  // write a number as two digits with leading zero, returns the position behind it
+  static char *print2(char *p, uint8_t value) {
+    *p++ = '0' + value / 10;
+    *p++ = '0' + value % 10;
+    return p;
+  }
+
   void printTime(DateTime now) {
-    String datum = String(weekday[now.dayOfTheWeek()]) + ", ";
-    datum = (now.day()<10) ? datum+"0"+now.day()+"." : datum+now.day()+".";
-    datum = (now.month()<10) ? datum+"0"+now.month()+"." : datum+now.month()+".";
-    datum += now.year();
+    // fixed buffers instead of String temporaries, which fragment the heap
+    char datum[15];     // "Mo, 11.02.2019"
+    char zeit[9];       // "12:35:07"
+    char *p = printDate(datum, now);
+    *p = '\0';
   
-    String zeit = (now.hour()<10) ? String("0")+now.hour()+":" : String("")+now.hour()+":";
-    zeit = (now.minute()<10) ? zeit+"0"+now.minute() : zeit+now.minute();
-    String zeits = (now.second()<10) ? zeit+":0"+now.second() : zeit+":"+now.second(); // time with seconds (used for serial monitor)
+    p = print2(zeit, now.hour());
+    *p++ = ':';
+    p = print2(p, now.minute());
+    *p++ = ':';
+    p = print2(p, now.second());
+    *p = '\0';
     
-    String weckzeit = (alarm1hour <10) ? String("0")+alarm1hour : String("")+alarm1hour;
-    weckzeit = (alarm1min < 10) ? weckzeit+":0"+alarm1min : weckzeit+":"+alarm1min;
-    
-    Serial.println(datum + ", " + zeits);
+    Serial.print(datum);
+    Serial.print(F(", "));
+    Serial.println(zeit);
     //printLCD("Mo, 11.02.2019", "12:35", true, "06:45", true, true);
-    printClock(datum.c_str(), zeit.c_str(), weckzeit.c_str());
+    markChanged(now);
+  }
+
+  // "Mo, 11.02.2019" without terminating zero, returns the position behind it
+  static char *printDate(char *p, DateTime now) {
+    *p++ = pgm_read_byte(&weekdays[2 * now.dayOfTheWeek()]);
+    *p++ = pgm_read_byte(&weekdays[2 * now.dayOfTheWeek() + 1]);
+    *p++ = ',';
+    *p++ = ' ';
+    p = print2(p, now.day());
+    *p++ = '.';
+    p = print2(p, now.month());
+    *p++ = '.';
+    p = print2(p, now.year() / 100);
+    return print2(p, now.year() % 100);
+  }
+
+  // only the characters that changed are drawn again
+  void markChanged(DateTime now) {
+    uint16_t changed = 0;
+    if (now.day() != shown.day() || now.month() != shown.month() || now.year() != shown.year()) {
+      changed |= bit(SLICE_DATE_LEFT) | bit(SLICE_DATE_RIGHT);
+    }
+    if (now.hour() / 10 != shown.hour() / 10) changed |= bit(SLICE_HOUR10);
+    if (now.hour() % 10 != shown.hour() % 10) changed |= bit(SLICE_HOUR1);
+    if (now.minute() / 10 != shown.minute() / 10) changed |= bit(SLICE_MIN10);
+    if (now.minute() % 10 != shown.minute() % 10) changed |= bit(SLICE_MIN1);
+    shown = now;
+    markDirty(changed);
+  }
+
+  // a slice that is marked again before it was drawn (e.g. every minute while
+  // the display is off) is drawn only once, the saved bytes are counted
+  void markDirty(uint16_t slices) {
+    uint16_t again = dirty & slices;
+    for (uint8_t i = 0; again != 0; i++, again >>= 1) {
+      if (again & 1) i2c.skip(I2C_OLED, pgm_read_byte(&sliceTiles[i]) * BENCH_I2C_OLED_TILE);
+    }
+    dirty |= slices;
   }
   
   void updateDisplay() {
-    DateTime now = rtc.now();
-    updateDisplay(now);
+#ifndef WECKER_BENCH
+    if (!rtcPresent) {
+      // without RTC there is no time to show, keep the error message
+      i2c.begin();
+      u8x8.setFont(u8x8_font_artossans8_r);
+      u8x8.drawString(3, 3, "RTC fehlt!");
+      i2c.end(I2C_OLED, 10 * BENCH_I2C_OLED_TILE);
+      return;
+    }
+#endif
+    // alarm time or symbols changed
+    markDirty(bit(SLICE_ALARM_ICON) | bit(SLICE_ALARM_TIME) | bit(SLICE_STAR) | bit(SLICE_SUN));
   }
   void updateDisplay(DateTime now) {
     printTime(now);
   }
 
-  void begin() {
-    Serial.println("Initialize display.");
+  // bring up display and RTC, returns false if the RTC is missing (the clock keeps running without time)
+  boolean begin() {
+    Serial.println(F("Initialize display."));
+    i2c.begin();
+    u8x8.setBusClock(Board::I2C_CLOCK);
     u8x8.begin();
     u8x8.clear();
     u8x8.setFlipMode(1);
+    i2c.end(I2C_OLED, 16 * 8 * BENCH_I2C_OLED_TILE);
 
-    Serial.println("Initialize RTC...");
-    if (! rtc.begin()) {
-      Serial.println("Kann RTC nicht finden");
-      while (1);
+    Serial.println(F("Initialize RTC..."));
+    rtcPresent = rtc.begin();
+    i2c.setClock(Board::I2C_CLOCK);   // rtc.begin() started Wire with 100 kHz
+    if (!rtcPresent) {
+      Serial.println(F("Kann RTC nicht finden"));
+      updateDisplay();
+      return false;
     }
   
     if (rtc.lostPower() || syncOnFirstStart) {
-      Serial.println("Die RTC war vom Strom getrennt. Die Zeit wird neu synchronisiert.");
+      Serial.println(F("Die RTC war vom Strom getrennt. Die Zeit wird neu synchronisiert."));
       // Über den folgenden Befehl wird die die RTC mit dem Zeitstempel versehen, zu dem der
       // Kompilierungsvorgang gestartet wurde, beginnt aber erst mit dem vollständigen Upload
       // selbst mit zählen. Daher geht die RTC von Anfang an wenige Sekunden nach.
       rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
       // rtc.adjust(DateTime(2014, 1, 21, 3, 0, 0));  // (DateTime(Jahr,Tag,Monat,Stunde,Minute,Sekunde))
       //printTime(rtc.now());
-      updateDisplay();
     }
+    update();   // show the time right away
+    while (drawSlice());
+    return true;
   }
 
   void pre2() {
@@ -111,57 +244,131 @@ class Clock {
     //u8x8.setCursor(0,1);
   }
 
-  void printClock(const char *datum, const char *zeit, const char *weckzeit) {
-    //u8x8.clear();
-    u8x8.setFont(u8x8_font_artossans8_r); 
-    u8x8.drawString(1, 0, datum);
-    u8x8.setFont(u8x8_font_inb21_2x4_n);
-    u8x8.drawString(3, 2, zeit);
-    if (alarm) {
-      if (alarmMusic) {
-        u8x8.setFont(u8x8_font_open_iconic_embedded_2x2);
-        u8x8.drawGlyph(1, 6, '@'+1);      // Alarm
-      }
-      u8x8.setFont(u8x8_font_artossans8_r); 
-      u8x8.drawString(4, 7, weckzeit);
-    }
-    if (showStar) {
-      //u8x8.setFont(u8x8_font_open_iconic_thing_2x2);
-      //u8x8.drawGlyph(14, 6, '@'+14);     // Flame
-      u8x8.setFont(u8x8_font_open_iconic_weather_2x2);
-      u8x8.drawGlyph(10, 6, '@'+4);      // Star
-    }
-    if (showSun) {
-      u8x8.setFont(u8x8_font_open_iconic_weather_2x2);
-      u8x8.drawGlyph(14, 6, '@'+5);      // Sun
+  // Draw the first part of the display that changed, at most I2C_SLICE_TILES
+  // tiles, so one call never holds the I2C bus for long. Returns false if
+  // there was nothing to draw.
+  boolean drawSlice() {
+#ifndef WECKER_BENCH
+    if (!rtcPresent) return false;
+#endif
+    if (dirty == 0) return false;
+    if (displayMode == DISPLAY_OFF) return false;   // kept dirty, drawn when the display is switched on again
+    uint8_t slice = 0;
+    while (!(dirty & bit(slice))) slice++;
+    dirty &= ~bit(slice);
+
+    char text[15];
+    i2c.begin();
+    switch (slice) {
+      case SLICE_DATE_LEFT:
+      case SLICE_DATE_RIGHT:
+        printDate(text, shown);
+        text[14] = '\0';
+        u8x8.setFont(u8x8_font_artossans8_r);
+        if (slice == SLICE_DATE_LEFT) {
+          text[7] = '\0';
+          u8x8.drawString(1, 0, text);
+        } else {
+          u8x8.drawString(8, 0, text + 7);
+        }
+        break;
+      case SLICE_HOUR10:
+      case SLICE_HOUR1:
+      case SLICE_COLON:
+      case SLICE_MIN10:
+      case SLICE_MIN1:
+        print2(text, shown.hour());
+        text[2] = ':';
+        print2(text + 3, shown.minute());
+        text[0] = text[slice - SLICE_HOUR10];
+        text[1] = '\0';
+        u8x8.setFont(u8x8_font_inb21_2x4_n);
+        u8x8.drawString(3 + 2 * (slice - SLICE_HOUR10), 2, text);
+        break;
+      case SLICE_ALARM_ICON:
+        if (alarm && alarmMusic) {
+          u8x8.setFont(u8x8_font_open_iconic_embedded_2x2);
+          u8x8.drawGlyph(1, 6, '@'+1);      // Alarm
+        } else {
+          clearSymbol(1);
+        }
+        break;
+      case SLICE_ALARM_TIME:
+        if (alarm) {
+          char *p = print2(text, alarm1hour);
+          *p++ = ':';
+          p = print2(p, alarm1min);
+          *p = '\0';
+        } else {
+          strcpy(text, "     ");
+        }
+        u8x8.setFont(u8x8_font_artossans8_r);
+        u8x8.drawString(4, 7, text);
+        break;
+      case SLICE_STAR:
+        if (showStar) {
+          //u8x8.setFont(u8x8_font_open_iconic_thing_2x2);
+          //u8x8.drawGlyph(14, 6, '@'+14);     // Flame
+          u8x8.setFont(u8x8_font_open_iconic_weather_2x2);
+          u8x8.drawGlyph(10, 6, '@'+4);      // Star
+        } else {
+          clearSymbol(10);
+        }
+        break;
+      case SLICE_SUN:
+        if (showSun) {
+          u8x8.setFont(u8x8_font_open_iconic_weather_2x2);
+          u8x8.drawGlyph(14, 6, '@'+5);      // Sun
+        } else {
+          clearSymbol(14);
+        }
+        break;
+      default:
+        break;
     }
+    i2c.end(I2C_OLED, pgm_read_byte(&sliceTiles[slice]) * BENCH_I2C_OLED_TILE);
+    return true;
   }
 
-  boolean checkAlarm1(DateTime now) {
-    if (now.hour() == alarm1hour && now.minute() == alarm1min) {
-      //Serial.println("     ALARM!!!!   ");
-      return true;
-    }
-    return false;
+  // remove a 2x2 symbol in the bottom line
+  void clearSymbol(uint8_t x) {
+    u8x8.setFont(u8x8_font_artossans8_r);
+    u8x8.drawString(x, 6, "  ");
+    u8x8.drawString(x, 7, "  ");
   }
 
-  boolean checkAlarm2(DateTime now) {
-    if (now.hour() == alarm2hour && now.minute() == alarm2min) {
-      //Serial.println("     ALARM2!!!!   ");
-      return true;
+  // phase of the alarm timeline at the given time, *since is set to the seconds spent in it
+  AlarmPhase phaseAt(DateTime now, uint32_t *since) {
+    uint32_t t = secsOfDay(now.hour(), now.minute()) + now.second();
+    uint32_t a0 = secsOfDay(alarm0hour, alarm0min);
+    uint32_t sunrise = getSecsBeforeAlarm();
+    uint32_t ring = getSecsAfterAlarm();
+    if (ring == 0) ring = 60;   // alarm 2 at the alarm time still rings for one minute
+    uint32_t s = secsBetween(a0, t);
+    if (s < sunrise) {
+      *since = s;
+      return PHASE_SUNRISE;
+    }
+    if (s < sunrise + ring) {
+      *since = s - sunrise;
+      return PHASE_RING;
     }
-    return false;
+    *since = 0;
+    return PHASE_IDLE;
   }
 
-  boolean checkAlarm0(DateTime now) {
-    if (now.hour() == alarm0hour && now.minute() == alarm0min) {
-      return true;
-    }
-    return false;
+  // RTC answered in begin()
+  boolean hasRtc() {
+    return rtcPresent;
   }
 
   void update() {
-    DateTime now = rtc.now();
+    if (!rtcPresent) return;
+    update(now());
+  }
+
+  // check alarms and refresh display for the given time (used by the benchmark to feed simulated time)
+  void update(DateTime now) {
     /*Serial.println("update");
     Serial.print("last shown minute: ");
     Serial.println(lastShownMinute);
@@ -169,17 +376,84 @@ class Clock {
     if (lastShownMinute != now.minute()) {
       lastShownMinute = now.minute();
       updateDisplay(now);
-      //checkAlarm(now);
-      if (checkAlarm1(now) && OnAlarm1 != NULL) {
-          OnAlarm1(); // call the callback
-      }
-      if (checkAlarm2(now) && OnAlarm2 != NULL) {
-          OnAlarm2(); // call the callback
-      }
-      if (checkAlarm0(now) && OnAlarm0 != NULL) {
-          OnAlarm0(); // call the callback
-      }
     }
+    updatePhase(now);
+    updateDisplayMode(now);
+  }
+
+  // display mode for the given time, see DisplayMode
+  DisplayMode displayModeAt(DateTime now) {
+    uint32_t t = secsOfDay(now.hour(), now.minute()) + now.second();
+    uint32_t a0 = secsOfDay(alarm0hour, alarm0min);
+    uint32_t bed = secsOfDay(bedHour, bedMin);
+    uint32_t night = secsOfDay(nightHour, nightMin);
+    if (wakeRequested) {
+      wakeRequested = false;
+      awake = true;
+      wakeEnd = (t + DISPLAY_WAKE_SECS) % 86400UL;
+    }
+    if (awake && secsBetween(t, wakeEnd) > DISPLAY_WAKE_SECS) awake = false;
+
+    if (secsBetween(bed, t) >= secsBetween(bed, a0)) return DISPLAY_DAY;
+    if (secsBetween(night, t) < secsBetween(night, a0) && !awake) return DISPLAY_OFF;
+    return DISPLAY_DIM;
+  }
+
+  void updateDisplayMode(DateTime now) {
+    DisplayMode mode = displayModeAt(now);
+    if (mode == displayMode) return;
+    i2c.begin();
+    if (mode == DISPLAY_OFF) {
+      u8x8.setPowerSave(1);
+    } else {
+      if (displayMode == DISPLAY_OFF) u8x8.setPowerSave(0);   // the panel kept its content, the slices changed while off are still dirty
+      u8x8.setContrast(mode == DISPLAY_DIM ? DISPLAY_CONTRAST_DIM : DISPLAY_CONTRAST_DAY);
+    }
+    i2c.end(I2C_OLED, 6);   // one or two commands
+    displayMode = mode;
+  }
+
+  // switch the display on for DISPLAY_WAKE_SECS, e.g. after a card swipe
+  void wakeDisplay() {
+    wakeRequested = true;
+  }
+  DisplayMode getDisplayMode() {
+    return displayMode;
+  }
+
+  // Move to the phase the given time falls into. Only the callback of the
+  // new phase is called, with getSecsInPhase() telling how far into it we
+  // are: after a reset or when the time is set during the sunrise, the
+  // sunrise continues at the right brightness, and when the alarm time was
+  // missed it rings right away without a sunrise first.
+  void updatePhase(DateTime now) {
+    uint32_t since;
+    AlarmPhase next = phaseAt(now, &since);
+    secsInPhase = since;
+    if (next == phase) return;
+    AlarmPhase previous = phase;
+    phase = next;
+    switch (next) {
+      case PHASE_SUNRISE:
+        if (OnAlarm0 != NULL) OnAlarm0();
+        break;
+      case PHASE_RING:
+        if (OnAlarm1 != NULL) OnAlarm1();
+        break;
+      case PHASE_IDLE:
+        // nothing to end right after a reset
+        if (previous != PHASE_UNKNOWN && OnAlarm2 != NULL) OnAlarm2();
+        break;
+      default:
+        break;
+    }
+  }
+
+  AlarmPhase getPhase() {
+    return phase;
+  }
+  uint16_t getSecsInPhase() {
+    return secsInPhase;
   }
 
   // for testing: set all three alarms freely
@@ -193,23 +467,23 @@ class Clock {
       alarm0hour = hours0;
       alarm0min = mins0;
       
-      Serial.print("Set alarm to ");
+      Serial.print(F("Set alarm to "));
       Serial.print(alarm1hour);
-      Serial.print(":");
+      Serial.print(F(":"));
       Serial.print(alarm1min);
-      Serial.print(" (before ");
+      Serial.print(F(" (before "));
       Serial.print(alarm0hour);
-      Serial.print(":");
+      Serial.print(F(":"));
       Serial.print(alarm0min);
-      Serial.print(", after ");
+      Serial.print(F(", after "));
       Serial.print(alarm2hour);
-      Serial.print(":");
+      Serial.print(F(":"));
       Serial.print(alarm2min);
-      Serial.println(")");
+      Serial.println(F(")"));
 
       if (alarm) updateDisplay(); // only show if alarm is active
     } else {
-      Serial.println("Alarm time could not be changed, because incorrect time given.");
+      Serial.println(F("Alarm time could not be changed, because incorrect time given."));
       correct = false;
     }
     return correct;
@@ -224,7 +498,7 @@ class Clock {
 
       // calculate alarm0 (before alarm 1)
       uint8_t hb = secsBefore / 3600;           // hours before
-      uint8_t mb = (secsBefore % 3600) / 1800;  // minutes before
+      uint8_t mb = (secsBefore % 3600) / 60;    // minutes before
       alarm0hour = (hours1 >= hb) ? hours1 - hb : hours1 + 24 - hb;
       if (minutes1 >= mb) {
         alarm0min = minutes1 - mb;
@@ -235,7 +509,7 @@ class Clock {
 
       // calculate alarm2 (after alarm 1)
       uint8_t ha = secsAfter / 3600;
-      uint8_t ma = (secsAfter % 3600) / 1800;
+      uint8_t ma = (secsAfter % 3600) / 60;
       alarm2hour = hours1 + ha;
       alarm2min = minutes1 + ma;
       if (alarm2min > 59) {
@@ -246,57 +520,43 @@ class Clock {
         alarm2hour -= 24;
       }
 
-      Serial.print("Set alarm to ");
+      Serial.print(F("Set alarm to "));
       Serial.print(alarm1hour);
-      Serial.print(":");
+      Serial.print(F(":"));
       Serial.print(alarm1min);
-      Serial.print(" (before ");
+      Serial.print(F(" (before "));
       Serial.print(alarm0hour);
-      Serial.print(":");
+      Serial.print(F(":"));
       Serial.print(alarm0min);
-      Serial.print(", after ");
+      Serial.print(F(", after "));
       Serial.print(alarm2hour);
-      Serial.print(":");
+      Serial.print(F(":"));
       Serial.print(alarm2min);
-      Serial.println(")");
+      Serial.println(F(")"));
 
       if (alarm) updateDisplay(); // only show if alarm is active
       
     } else {
-      Serial.println("Alarm time could not be changed, because incorrect time given.");
+      Serial.println(F("Alarm time could not be changed, because incorrect time given."));
       correct = false;
     }
     return correct;
   }
 
+  // length of the sunrise, alarm 0 may be before midnight
   uint16_t getSecsBeforeAlarm() {
-    uint16_t diff = 0;
-    long millis1 = 0;
-    long millis0 = 0;
-    millis1 = (alarm1min * 60000) + (alarm1hour * 3600000);
-    millis0 = (alarm0min * 60000) + (alarm0hour * 3600000);
-    if (millis1 >= millis0) {
-      diff = (millis1 - millis0) / 1000;
-    } else {
-      Serial.println("Fehler: alarm0 ist größer als alarm1");
-    }
-    //Serial.println(millis0);
-    //Serial.println(millis1);
-    Serial.println(diff);
-    return diff;
+    return secsBetween(secsOfDay(alarm0hour, alarm0min), secsOfDay(alarm1hour, alarm1min));
   }
   uint16_t getSecsAfterAlarm() {
-    uint16_t diff = 0;
-    long millis1 = 0;
-    long millis2 = 0;
-    millis1 = (alarm1min * 60000) + (alarm1hour * 3600000);
-    millis2 = (alarm2min * 60000) + (alarm2hour * 3600000);
-    if (millis2 >= millis1) {
-      diff = (millis2 - millis1) / 1000;
-    } else {
-      Serial.println("Fehler: alarm1 ist größer als alarm2");
-    }
-    return diff;
+    return secsBetween(secsOfDay(alarm1hour, alarm1min), secsOfDay(alarm2hour, alarm2min));
+  }
+
+  static uint32_t secsOfDay(uint8_t hours, uint8_t minutes) {
+    return hours * 3600UL + minutes * 60UL;
+  }
+  // seconds from one time of day to the next occurrence of another
+  static uint32_t secsBetween(uint32_t from, uint32_t to) {
+    return (to + 86400UL - from) % 86400UL;
   }
 
   void showSunSymbol(boolean sun) {
@@ -325,8 +585,28 @@ class Clock {
     updateDisplay();
   }
 
+  // set the time of the RTC, the date is kept
+  boolean setTime(uint8_t hours, uint8_t minutes, uint8_t seconds) {
+    if (hours > 23 || minutes > 59 || seconds > 59) {
+      Serial.println(F("Time could not be changed, because incorrect time given."));
+      return false;
+    }
+    DateTime n = now();
+    rtc.adjust(DateTime(n.year(), n.month(), n.day(), hours, minutes, seconds));
+    lastShownMinute = 60;   // redraw with the next update
+    return true;
+  }
+
   DateTime now() {
-    return rtc.now();
+#ifdef WECKER_BENCH
+    i2c.count(I2C_RTC, BENCH_I2C_RTC_READ, 0);
+    return bench.now();
+#else
+    i2c.begin();
+    DateTime t = rtc.now();
+    i2c.end(I2C_RTC, BENCH_I2C_RTC_READ);
+    return t;
+#endif
   }
 };
 #endif
@@ -0,0 +1,96 @@
+#ifndef __CONSOLE__
+#define __CONSOLE__
+/*
+ * Serial command console for the running clock.
+ *
+ * update() takes at most one byte from the serial port per call and parses
+ * it on the fly: a command letter followed by up to CONSOLE_MAX_ARGS numbers,
+ * separated by any non-digit characters. The line ends with '\n', '\r' or '#'.
+ * No buffer for the line is kept and nothing is allocated, so calling it once
+ * per loop() never stalls the LEDs or the card reader.
+ *
+ *   A 6:45       set alarm to 06:45 and switch it on
+ *   A 0          switch the alarm off (A 1 switches it on again)
+ *   D            dump the event trace, see FlightRecorder.h
+ *   N 19:00 20:30  dim the display from 19:00, switch it off from 20:30
+ *   P 1          play light pattern (same numbers as on the cards)
+ *   P 6 255 0 0  play light pattern with color
+ *   S            dump statistics
+ *   T 21:30:00   set the time of the RTC
+ */
+#include <Arduino.h>
+
+#define CONSOLE_MAX_ARGS 4
+
+class Console {
+  private:
+  Stream &stream;
+  char command;                     // command letter, 0 while waiting for one
+  int16_t args[CONSOLE_MAX_ARGS];
+  uint8_t argc;
+  boolean inNumber;                 // currently reading digits of args[argc]
+  boolean overflow;                 // line had too many arguments
+
+  public:
+  void (*OnCommand)(char command, uint8_t argc, const int16_t *args);  // Callback for a complete line
+
+  // constructor
+  Console(Stream &s, void (*callback)(char, uint8_t, const int16_t *)) : stream(s) {
+    OnCommand = callback;
+    reset();
+  }
+
+  // stream the commands come from, replies go there as well
+  Stream &output() {
+    return stream;
+  }
+
+  // process at most one byte from the serial port
+  void update() {
+    if (stream.available() <= 0) return;
+    char c = stream.read();
+
+    if (c == '\n' || c == '\r' || c == '#') {
+      endNumber();
+      if (command != 0) {
+        if (overflow) {
+          stream.println(F("Zu viele Argumente"));
+        } else if (OnCommand != NULL) {
+          OnCommand(command, argc, args);
+        }
+      }
+      reset();
+    } else if (command == 0) {
+      if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+      if (c >= 'A' && c <= 'Z') command = c;
+    } else if (c >= '0' && c <= '9') {
+      if (!inNumber) {
+        if (argc >= CONSOLE_MAX_ARGS) {
+          overflow = true;
+          return;
+        }
+        args[argc] = 0;
+        inNumber = true;
+      }
+      if (args[argc] < 1000) args[argc] = args[argc] * 10 + (c - '0');
+    } else {
+      endNumber();
+    }
+  }
+
+  private:
+  void endNumber() {
+    if (inNumber) {
+      argc++;
+      inNumber = false;
+    }
+  }
+
+  void reset() {
+    command = 0;
+    argc = 0;
+    inNumber = false;
+    overflow = false;
+  }
+};
+#endif
@@ -0,0 +1,77 @@
+#ifndef __EVENTQUEUE__
+#define __EVENTQUEUE__
+/*
+ * Fixed size event queue between the modules and loop().
+ *
+ * Callbacks of Clock, NeoPattern and Mp3Notify only post an event; the work
+ * is done when loop() dispatches the queue. So no update() call ever runs
+ * another module's code (e.g. show() from inside SunUpdate, or a blocking
+ * mp3 query from inside Clock::update).
+ *
+ * The consumer side (pop) is lock-free: only loop() moves tail, producers
+ * only move head, and both indices are single bytes. post() may be called
+ * from an ISR; from normal code it disables interrupts for the few cycles
+ * it needs, because there are producers in both contexts.
+ */
+#include <Arduino.h>
+#include <util/atomic.h>
+
+#define EVENT_QUEUE_SIZE 8   // power of two
+
+enum EventType : byte {
+  EV_NONE = 0,
+  EV_ALARM_PRE,         // alarm 0: start of sunrise
+  EV_ALARM,             // alarm 1: wake up
+  EV_ALARM_POST,        // alarm 2: end of alarm
+  EV_PATTERN_COMPLETE,  // arg: pattern that completed
+  EV_CARD_READ,         // arg: 1 if the card could be read
+  EV_MP3_STARTED,       // arg: track in current folder, 0 for a voice command
+  EV_MP3_FINISHED,      // arg: track in current folder or 0, not sent after stop()
+  EV_MP3_ERROR          // arg: DfMp3_Error code
+};
+
+struct Event {
+  EventType type;
+  uint16_t arg;
+};
+
+class EventQueue {
+  private:
+  volatile Event events[EVENT_QUEUE_SIZE];
+  volatile uint8_t head;   // next free slot, written by producers
+  volatile uint8_t tail;   // next event to dispatch, written by loop()
+
+  public:
+  uint8_t dropped;         // events lost because the queue was full
+
+  EventQueue() : head(0), tail(0), dropped(0) {}
+
+  // add an event, returns false if the queue is full
+  boolean post(EventType type, uint16_t arg = 0) {
+    boolean ok = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      uint8_t next = (head + 1) & (EVENT_QUEUE_SIZE - 1);
+      if (next == tail) {
+        dropped++;
+      } else {
+        events[head].type = type;
+        events[head].arg = arg;
+        head = next;
+        ok = true;
+      }
+    }
+    return ok;
+  }
+
+  // take the oldest event, returns false if there is none
+  boolean pop(Event *event) {
+    if (tail == head) return false;
+    event->type = events[tail].type;
+    event->arg = events[tail].arg;
+    tail = (tail + 1) & (EVENT_QUEUE_SIZE - 1);
+    return true;
+  }
+};
+
+extern EventQueue events;
+#endif
@@ -0,0 +1,168 @@
+#ifndef __FLIGHTRECORDER__
+#define __FLIGHTRECORDER__
+/*
+ * Event trace that survives a reset, for finding out why an alarm misfired.
+ *
+ * Every record is 8 bytes (sequence number, type, argument, RTC time) and is
+ * first kept in a small RAM ring. Once TRACE_FLUSH_BATCH records are pending,
+ * or the oldest one waited TRACE_FLUSH_AGE ms, they are copied into a ring in
+ * the internal EEPROM, one byte per loop() and only when the EEPROM is ready,
+ * so a flush never blocks the loop (a single EEPROM write takes 3.3 ms).
+ * EEPROM.update() skips bytes that do not change.
+ *
+ * The sequence number of a record is written last. After a reset begin()
+ * looks for the first record that does not continue the sequence, which is
+ * the oldest one (or a torn one), and writing continues there.
+ *
+ * "D" on the console dumps the trace as "trace,<16 hex digits>" lines, oldest
+ * first; tools/decode_trace.py turns a saved dump into a timeline.
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include "Bench.h"
+
+#define TRACE_EEPROM_START 0       // first byte used in the EEPROM
+#define TRACE_EEPROM_SLOTS 128     // records in the EEPROM (1 KB on the ATmega328P)
+#define TRACE_RAM_SLOTS    8       // power of two
+#define TRACE_FLUSH_BATCH  4       // pending records that start a flush
+#define TRACE_FLUSH_AGE    60000   // ms a record may wait in RAM
+
+// record types; the values below 0x80 are the EventType of the traced event
+enum TraceType : byte {
+  TR_BOOT     = 0x80,   // arg: reset flags (MCUSR, see saveResetFlags() in the sketch)
+  TR_OVERRUN  = 0x81,   // arg: ms one loop() iteration took
+  TR_EMPTY    = 0xFF    // erased EEPROM
+};
+
+struct TraceRecord {
+  uint8_t seq;          // running number, written last
+  uint8_t type;         // EventType or TraceType
+  uint16_t arg;
+  uint32_t time;        // seconds since 2000-01-01, or since boot before the RTC was read
+};
+
+class FlightRecorder {
+  private:
+  TraceRecord ram[TRACE_RAM_SLOTS];
+  uint8_t head;                 // next free slot in ram
+  uint8_t tail;                 // next record to flush
+  uint8_t flushByte;            // byte of ram[tail] that is written next
+  boolean flushing;
+  uint16_t loggedAt[TRACE_RAM_SLOTS];   // millis() / 1024 when the record was logged
+  uint8_t slot;                 // next record in the EEPROM
+  uint8_t nextSeq;
+  uint32_t baseSecs;            // RTC time at baseMs
+  unsigned long baseMs;
+
+  public:
+  uint8_t dropped;              // records lost because the RAM ring was full
+
+  FlightRecorder() : head(0), tail(0), flushByte(0), flushing(false), slot(0), nextSeq(0), baseSecs(0), baseMs(0), dropped(0) {}
+
+  // find the write position in the EEPROM
+  void begin() {
+    if (EEPROM.read(address(0) + 1) == TR_EMPTY) {
+      slot = 0;
+      nextSeq = 0;
+      return;
+    }
+    uint8_t prev = EEPROM.read(address(0));
+    slot = 0;
+    for (uint8_t i = 1; i < TRACE_EEPROM_SLOTS; i++) {
+      uint8_t seq = EEPROM.read(address(i));
+      if (seq != (uint8_t)(prev + 1)) {
+        slot = i;
+        break;
+      }
+      prev = seq;
+    }
+    nextSeq = prev + 1;
+  }
+
+  // time of the RTC, called whenever the clock was read
+  void sync(uint32_t secs, unsigned long ms) {
+    baseSecs = secs;
+    baseMs = ms;
+  }
+
+  void log(uint8_t type, uint16_t arg) {
+    uint8_t next = (head + 1) & (TRACE_RAM_SLOTS - 1);
+    if (next == tail) {
+      dropped++;
+      return;
+    }
+#ifdef WECKER_BENCH
+    unsigned long ms = bench.millis();
+#else
+    unsigned long ms = millis();
+#endif
+    loggedAt[head] = ms >> 10;
+    ram[head].type = type;
+    ram[head].arg = arg;
+    ram[head].time = baseSecs + (ms - baseMs) / 1000;
+    head = next;
+  }
+
+  // write at most one byte to the EEPROM
+  void loop(unsigned long ms) {
+    uint8_t pending = (head - tail) & (TRACE_RAM_SLOTS - 1);
+    if (pending == 0) {
+      flushing = false;
+      return;
+    }
+    if (!flushing) {
+      uint16_t age = (uint16_t)(ms >> 10) - loggedAt[tail];   // wraps after 18 h
+      if (pending < TRACE_FLUSH_BATCH && age < (TRACE_FLUSH_AGE >> 10)) return;
+      flushing = true;
+    }
+    if (!eeprom_is_ready()) return;
+
+    ram[tail].seq = nextSeq;
+    // bytes 1 - 7 first, the sequence number (byte 0) marks the record as complete
+    uint8_t i = (flushByte + 1) & 7;
+#ifndef WECKER_BENCH
+    EEPROM.update(address(slot) + i, ((const uint8_t *)&ram[tail])[i]);
+#endif
+    if (++flushByte < sizeof(TraceRecord)) return;
+
+    flushByte = 0;
+    nextSeq++;
+    slot = (slot + 1) % TRACE_EEPROM_SLOTS;
+    tail = (tail + 1) & (TRACE_RAM_SLOTS - 1);
+  }
+
+  // print all records, EEPROM first, then the ones still waiting in RAM
+  void dump(Print &out) {
+    TraceRecord record;
+    for (uint8_t i = 0; i < TRACE_EEPROM_SLOTS; i++) {
+      uint8_t s = (slot + i) % TRACE_EEPROM_SLOTS;
+      EEPROM.get(address(s), record);
+      if (record.type == TR_EMPTY) continue;
+      print(out, record);
+    }
+    for (uint8_t i = tail; i != head; i = (i + 1) & (TRACE_RAM_SLOTS - 1)) {
+      print(out, ram[i]);
+    }
+    out.print(F("trace,dropped,"));
+    out.println(dropped);
+  }
+
+  private:
+  static int address(uint8_t s) {
+    return TRACE_EEPROM_START + s * sizeof(TraceRecord);
+  }
+
+  static void print(Print &out, const TraceRecord &record) {
+    out.print(F("trace,"));
+    const uint8_t *p = (const uint8_t *)&record;
+    for (uint8_t i = 0; i < sizeof(TraceRecord); i++) {
+      if (p[i] < 0x10) out.print('0');
+      out.print(p[i], HEX);
+    }
+    out.println();
+  }
+};
+
+extern FlightRecorder trace;
+#endif
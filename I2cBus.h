@@ -0,0 +1,97 @@
+#ifndef __I2CBUS__
+#define __I2CBUS__
+/*
+ * Bookkeeping for the I2C bus shared by the RTC and the OLED.
+ *
+ * Both devices run at Board::I2C_CLOCK (400 kHz fast mode, supported by the
+ * DS3231, SH1106 and SSD1306). Transfers are not queued, loop() decides who
+ * may use the bus: the RTC read comes first, and in an iteration with a RTC
+ * read the display waits. Clock draws the display in slices of at most
+ * I2C_SLICE_TILES tiles, so no transfer holds the bus for long.
+ *
+ * Every transfer is counted per device: bytes on the wire (estimated, the
+ * drivers are not instrumented), total and longest time, and the bytes of
+ * transfers that were not needed (display redraws merged while it is off).
+ * "S" on the console prints "stat,i2c_<device>,bytes,us,max_us,saved".
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include "Bench.h"
+
+#define I2C_SLICE_TILES 8   // 8x8 tiles the display may draw per loop() iteration
+
+enum I2cDevice : byte {
+  I2C_RTC = 0,
+  I2C_OLED,
+  I2C_DEVICES
+};
+
+class I2cBus {
+  public:
+  uint32_t bytes[I2C_DEVICES];        // bytes on the wire
+  uint32_t busMicros[I2C_DEVICES];    // time spent in transfers
+  uint16_t maxMicros[I2C_DEVICES];    // longest transfer
+  uint32_t saved[I2C_DEVICES];        // bytes of transfers that were not needed
+
+  private:
+  unsigned long start;
+  boolean used;                       // bus was used in this loop() iteration
+
+  public:
+  I2cBus() : used(false) {
+    memset(bytes, 0, sizeof(bytes));
+    memset(busMicros, 0, sizeof(busMicros));
+    memset(maxMicros, 0, sizeof(maxMicros));
+    memset(saved, 0, sizeof(saved));
+  }
+
+  // Wire.begin() (e.g. in RTC_DS3231::begin()) resets the clock to 100 kHz
+  void setClock(uint32_t clock) {
+    Wire.setClock(clock);
+  }
+
+  // start of a loop() iteration, the bus is free again
+  void nextSlot() {
+    used = false;
+  }
+  boolean busy() {
+    return used;
+  }
+
+  void begin() {
+    start = micros();
+  }
+  void end(I2cDevice device, uint16_t n) {
+    uint32_t duration = micros() - start;
+    count(device, n, duration);
+  }
+
+  void count(I2cDevice device, uint16_t n, uint32_t duration) {
+    used = true;
+    bytes[device] += n;
+    busMicros[device] += duration;
+    if (duration > maxMicros[device]) maxMicros[device] = min(duration, 0xFFFFUL);
+    BENCH_COUNT(i2cBytes, n);
+  }
+
+  // a transfer that was skipped or merged with a later one
+  void skip(I2cDevice device, uint16_t n) {
+    saved[device] += n;
+  }
+
+  void report(Print &out) {
+    for (uint8_t d = 0; d < I2C_DEVICES; d++) {
+      out.print(d == I2C_RTC ? F("stat,i2c_rtc,") : F("stat,i2c_oled,"));
+      out.print(bytes[d]);
+      out.print(',');
+      out.print(busMicros[d]);
+      out.print(',');
+      out.print(maxMicros[d]);
+      out.print(',');
+      out.println(saved[d]);
+    }
+  }
+};
+
+extern I2cBus i2c;
+#endif
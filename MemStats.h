@@ -0,0 +1,100 @@
+#ifndef __MEMSTATS__
+#define __MEMSTATS__
+/*
+ * SRAM accounting for the ATmega328P (2 KB).
+ *
+ * RAM layout:  | .data | .bss | heap -> ...free... <- stack | RAMEND
+ *
+ * - paint() fills the free gap between heap and stack with a canary byte.
+ *   stackHeadroom() later counts how many canary bytes are still untouched
+ *   above the heap, which is the minimum distance the stack ever had to the
+ *   heap (high-water mark).
+ * - heapFree() walks the malloc free list of avr-libc to report free heap
+ *   blocks and the largest one (fragmentation).
+ * - MEM_FOOTPRINT(obj) prints sizeof(obj) next to the runtime numbers.
+ *   The build-time list of every object in .data/.bss comes from
+ *   tools/mem_footprint.sh, which reads the symbol sizes from the ELF file.
+ *
+ * Every line is printed as "mem,<name>,<bytes>".
+ */
+#include <Arduino.h>
+
+#define MEM_CANARY  0xC5
+#define MEM_MARGIN    32   // bytes below the current stack pointer left unpainted
+
+extern int __heap_start, *__brkval;
+extern int __data_start, __data_end, __bss_start, __bss_end;
+
+// avr-libc malloc free list entry
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+
+#define MEM_FOOTPRINT(obj) MemStats::printEntry(F(#obj), sizeof(obj))
+
+class MemStats {
+  public:
+
+  // first byte above the heap
+  static uint8_t *heapEnd() {
+    return (uint8_t *)(__brkval == 0 ? (int)&__heap_start : (int)__brkval);
+  }
+
+  // free RAM between heap and stack right now
+  static uint16_t freeMemory() {
+    uint8_t v;
+    return &v - heapEnd();
+  }
+
+  // fill the gap between heap and stack with the canary (call first thing in setup())
+  static void paint() {
+    uint8_t v;
+    for (uint8_t *p = heapEnd(); p < &v - MEM_MARGIN; p++) *p = MEM_CANARY;
+  }
+
+  // number of canary bytes the stack has never overwritten
+  static uint16_t stackHeadroom() {
+    uint8_t v;
+    uint8_t *p = heapEnd();
+    uint16_t count = 0;
+    while (p < &v && *p == MEM_CANARY) {
+      p++;
+      count++;
+    }
+    return count;
+  }
+
+  // total size of free blocks on the heap free list, largest block in *largest
+  static uint16_t heapFree(uint16_t *largest) {
+    uint16_t total = 0;
+    *largest = 0;
+    for (struct __freelist *fp = __flp; fp != NULL; fp = fp->nx) {
+      total += fp->sz + sizeof(size_t);
+      if (fp->sz > *largest) *largest = fp->sz;
+    }
+    return total;
+  }
+
+  static void printEntry(const __FlashStringHelper *name, uint16_t bytes) {
+    Serial.print(F("mem,"));
+    Serial.print(name);
+    Serial.print(',');
+    Serial.println(bytes);
+  }
+
+  // sections, heap and stack usage
+  static void report() {
+    uint16_t largest;
+    uint16_t listFree = heapFree(&largest);
+    printEntry(F("data"), (int)&__data_end - (int)&__data_start);
+    printEntry(F("bss"), (int)&__bss_end - (int)&__bss_start);
+    printEntry(F("heap"), heapEnd() - (uint8_t *)&__heap_start);
+    printEntry(F("heap_free"), listFree);
+    printEntry(F("heap_largest"), largest);
+    printEntry(F("free"), freeMemory());
+    printEntry(F("stack_headroom"), stackHeadroom());
+  }
+};
+#endif
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <DFMiniMp3.h>
 #include <SoftwareSerial.h>
+#include "Bench.h"
+#include "EventQueue.h"
 
 // implement a notification class,
 // its member methods will get called 
@@ -13,49 +15,51 @@ public:
   static void OnError(uint16_t errorCode) {
     // see DfMp3_Error for code meaning
     Serial.println();
-    Serial.print("Com Error ");
+    Serial.print(F("Com Error "));
     Serial.println(errorCode);
+    events.post(EV_MP3_ERROR, errorCode);
   }
 
   static void OnPlayFinished(uint16_t globalTrack) {
     Serial.println();
-    Serial.print("Play finished for #");
+    Serial.print(F("Play finished for #"));
     Serial.println(globalTrack);   
+    // end of track is taken from the BUSY pin, see Mp3Player::updateBusy()
   }
 
   static void OnCardOnline(uint16_t code) {
     Serial.println();
-    Serial.print("Card online ");
+    Serial.print(F("Card online "));
     Serial.println(code);     
   }
 
   static void OnUsbOnline(uint16_t code) {
     Serial.println();
-    Serial.print("USB Disk online ");
+    Serial.print(F("USB Disk online "));
     Serial.println(code);     
   }
 
   static void OnCardInserted(uint16_t code) {
     Serial.println();
-    Serial.print("Card inserted ");
+    Serial.print(F("Card inserted "));
     Serial.println(code); 
   }
 
   static void OnUsbInserted(uint16_t code) {
     Serial.println();
-    Serial.print("USB Disk inserted ");
+    Serial.print(F("USB Disk inserted "));
     Serial.println(code); 
   }
 
   static void OnCardRemoved(uint16_t code) {
     Serial.println();
-    Serial.print("Card removed ");
+    Serial.print(F("Card removed "));
     Serial.println(code);  
   }
 
   static void OnUsbRemoved(uint16_t code) {
     Serial.println();
-    Serial.print("USB Disk removed ");
+    Serial.print(F("USB Disk removed "));
     Serial.println(code);  
   }
 };
@@ -67,57 +71,127 @@ enum Mp3VoiceCommand : byte {
   // bing am start, "Diese Karte ist unbekannt" oder möööp, anderes bing für erkannte Karte
 };
 
+#define MP3_BUSY_DEBOUNCE  30   // ms the BUSY pin has to be stable before an edge counts
+
+// Playback state comes from the BUSY pin of the DFPlayer (low while playing),
+// which costs no UART traffic. The pin is sampled in loop() and not by a
+// pin change interrupt, because SoftwareSerial already occupies all PCINT
+// vectors; a loop() iteration takes only a few ms, so the edges are still
+// timestamped well within the debounce time.
 class Mp3Player: public DFMiniMp3<SoftwareSerial, Mp3Notify> {
   private:
   SoftwareSerial mySoftwareSerial;
   //uint16_t lastTrackFinished;
+  boolean busyRaw;              // last sampled state of the BUSY pin
+  unsigned long busyChanged;    // time of the last change of busyRaw
+  boolean playing;              // debounced playback state
+  boolean stopRequested;        // the next end of playback was caused by stop()
+  boolean commandSound;         // the last playback started is a voice command, not a folder track
+  unsigned long playStart;      // time playback started
+  unsigned long lastDuration;   // length of the last playback in ms
 
   public:
   uint16_t numTracksInFolder;
   uint8_t currentTrack;
   uint8_t currentFolder;
   byte busyPin;
+  boolean online;     // begin() was called, commands are sent to the player
   Mp3Player(byte rx, byte tx, byte busy) :  busyPin(busy), mySoftwareSerial(rx, tx), DFMiniMp3<SoftwareSerial, Mp3Notify>(mySoftwareSerial)
-  {}
+  {
+    online = false;
+    busyRaw = playing = stopRequested = commandSound = false;
+    busyChanged = playStart = lastDuration = 0;
+  }
 
   void begin() {  // overrides begin() of base class
-    Serial.println("Initialize mp3 player");
+    Serial.println(F("Initialize mp3 player"));
+    pinMode(busyPin, INPUT_PULLUP);   // reads "not playing" if no player is connected
     DFMiniMp3::begin(); // caution: uses 9600 for software serial connection
     setVolume(20);
+    BENCH_COUNT(uartBytes, BENCH_UART_MP3_CMD);
+    online = true;
+  }
+
+  void loop() {  // hides loop() of base class, nothing to read before begin()
+    if (!online) return;
+    DFMiniMp3::loop();
+    updateBusy(millis());
+  }
+
+  // sample the BUSY pin, post EV_MP3_STARTED / EV_MP3_FINISHED on debounced edges
+  void updateBusy(unsigned long now) {
+    boolean busy = !digitalRead(busyPin);
+    if (busy != busyRaw) {
+      busyRaw = busy;
+      busyChanged = now;
+      return;
+    }
+    if (busy == playing || now - busyChanged < MP3_BUSY_DEBOUNCE) return;
+    playing = busy;
+    if (playing) {
+      playStart = busyChanged;
+      events.post(EV_MP3_STARTED, track());
+    } else {
+      lastDuration = busyChanged - playStart;
+      if (!stopRequested) events.post(EV_MP3_FINISHED, track());   // end of track
+      stopRequested = false;
+    }
+  }
+
+  // track of the playback in the current folder, 0 for a voice command
+  uint8_t track() {
+    return commandSound ? 0 : currentTrack;
+  }
+
+  bool isPlaying() {
+    return playing;
+  }
+
+  // ms of the current playback, or of the last one if nothing is playing
+  unsigned long playDuration() {
+    return playing ? millis() - playStart : lastDuration;
   }
 
   void playCommandSound(Mp3VoiceCommand com) {
+    if (!online) return;
+    commandSound = true;
     playMp3FolderTrack(com);
+    BENCH_COUNT(uartBytes, BENCH_UART_MP3_CMD);
   }
 
   void setFolder(uint8_t folder) {
     currentFolder = folder;
+    if (!online) return;
     numTracksInFolder = getFolderTrackCount(folder);
+    BENCH_COUNT(uartBytes, BENCH_UART_MP3_QUERY);
     currentTrack = 1;
-    Serial.print("Set Folder to ");
+    Serial.print(F("Set Folder to "));
     Serial.print(folder);
-    Serial.print(" (");
+    Serial.print(F(" ("));
     Serial.print(numTracksInFolder);
-    Serial.println(" tracks in folder)!");
+    Serial.println(F(" tracks in folder)!"));
   }
 
   void play() {
+    if (!online) return;
+    commandSound = false;
     playFolderTrack(currentFolder, currentTrack);
+    BENCH_COUNT(uartBytes, BENCH_UART_MP3_CMD);
   }
 
-  /*bool isPlaying() { 
-    return !digitalRead(busyPin); 
+  // next track in the current folder, starts over after the last one
+  void next() {
+    currentTrack = (numTracksInFolder == 0 || currentTrack >= numTracksInFolder) ? 1 : currentTrack + 1;
+    play();
+  }
+
+  void stop() {  // hides stop() of base class to count the command
+    if (!online) return;
+    stopRequested = playing;
+    DFMiniMp3::stop();
+    BENCH_COUNT(uartBytes, BENCH_UART_MP3_CMD);
   }
 
-  // override
-  void loop() {
-    DFMiniMp3::loop();
-    //Serial.println("Extra!");
-    //listenForReply(0x00);
-    uint8_t replyCommand = 0;
-    uint16_t replyArg = 0;
-    
-  }*/
   
 };
 #endif
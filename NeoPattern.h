@@ -3,13 +3,39 @@
 
 #include <Arduino.h>
 #include <Adafruit_NeoPixel.h>
+#include "Board.h"
 
 // Pattern types supported:
-enum  pattern { NONE, RAINBOW_CYCLE, FADE, STEADY, SUNUP, SUNDOWN, SUNDOWNN, NIGHTLIGHT };
+enum  pattern { NONE, RAINBOW_CYCLE, FADE, STEADY, SUNUP, SUNDOWN, SUNDOWNN, NIGHTLIGHT, SUNARC, COMET, BREATHE };
 // Patern directions supported:
 enum  direction { FORWARD, REVERSE };
 
-// NeoPattern Class - derived from the Adafruit_NeoPixel class
+#define SUN_FRAME_INTERVAL  20   // ms between two frames of sunrise / sundown (50 fps)
+#define COMET_TAIL           6   // pixels behind the head of the comet
+#define ARC_EDGE            16   // width of the soft edge of the sun arc (1/128 of half the ring)
+
+// Angular distance of each ring pixel from the bottom of the ring,
+// 0 (bottom) - 128 (top). Precomputed for the 24 LED ring with pixel 12 at the bottom.
+#define RING_PIXELS         24
+static const uint8_t RingAngle[RING_PIXELS] PROGMEM = {
+  128, 117, 107, 96, 85, 75, 64, 53, 43, 32, 21, 11, 0, 11, 21, 32, 43, 53, 64, 75, 85, 96, 107, 117
+};
+
+// Green channel of the sun for steps 0, 4, ... 200: (5^(step/66.7) - 1) * 128,
+// 8.8 fixed point, interpolated in between (no pow() per frame).
+#define SUN_GREEN_STEPS     51
+static const uint16_t SunGreen[SUN_GREEN_STEPS] PROGMEM = {
+  0, 13, 27, 43, 60, 79, 100, 124, 149, 177,
+  208, 242, 280, 321, 366, 416, 472, 532, 599, 673,
+  754, 844, 942, 1050, 1170, 1301, 1446, 1606, 1781, 1975,
+  2188, 2423, 2681, 2966, 3279, 3624, 4005, 4423, 4885, 5393,
+  5952, 6568, 7247, 7994, 8817, 9723, 10721, 11821, 13031, 14365,
+  15833
+};
+
+// NeoPattern Class - derived from the Adafruit_NeoPixel class,
+// pin, type and number of LEDs come from the Board configuration
+template <class Board>
 class NeoPattern : public Adafruit_NeoPixel {
     public:
 
@@ -17,27 +43,47 @@ class NeoPattern : public Adafruit_NeoPixel {
     pattern  ActivePattern;  // which pattern is running
     direction Direction;     // direction to run the pattern
     
-    unsigned long Interval;   // milliseconds between updates
-    unsigned long lastUpdate; // last update of position
+    unsigned long Interval;   // milliseconds between frames
+    unsigned long lastUpdate; // time of the last frame
+    unsigned long StartTime;  // time the current pass of the pattern started
+    unsigned long Duration;   // milliseconds for one pass over all steps
     
     uint32_t Color1, Color2;  // What colors are in use
     uint16_t TotalSteps;  // total number of steps in the pattern
     uint16_t Index;  // current step within the pattern
+    uint8_t Fraction;  // position between Index and the next step (1/256)
+    boolean Dither;    // diffuse the fractional part of 16 bit colors (see ColorSet16)
     
     void (*OnComplete)();  // Callback on completion of pattern
     
     // Constructor - calls base-class constructor to initialize strip
-    NeoPattern(uint16_t pixels, uint8_t pin, uint8_t type, void (*callback)())
-    :Adafruit_NeoPixel(pixels, pin, type) {
+    NeoPattern(void (*callback)())
+    :Adafruit_NeoPixel(Board::LED_COUNT, Board::LED_PIN, Board::LED_TYPE) {
         OnComplete = callback;
+        Started = true;
+        Dither = false;
+        ErrRed = ErrGreen = ErrBlue = 0;
     }
     
     // Update the pattern
     void Update()
     {
-        if((millis() - lastUpdate) > Interval) // time to update
+        Update(millis());
+    }
+
+    // Update the pattern for the given time (used by the benchmark to feed simulated time)
+    void Update(unsigned long now)
+    {
+        if (!Started) // first frame of a new pattern
         {
-            lastUpdate = millis();
+            StartTime = now - StartOffset;
+            lastUpdate = now - Interval - 1;
+            Started = true;
+        }
+        if(Animated() && (now - lastUpdate) >= Interval) // time to update
+        {
+            lastUpdate = now;
+            boolean complete = Seek(now);
             switch(ActivePattern)
             {
                 case RAINBOW_CYCLE:
@@ -51,54 +97,115 @@ class NeoPattern : public Adafruit_NeoPixel {
                 case SUNDOWNN:
                     SunUpdate();
                     break;
+                case SUNARC:
+                    SunArcUpdate();
+                    break;
+                case COMET:
+                    CometUpdate();
+                    break;
+                case BREATHE:
+                    BreatheUpdate();
+                    break;
                 default:
                     break;
             }
+            if (complete && OnComplete != NULL)
+            {
+                OnComplete(); // call the completion callback
+            }
         }
     }
   
-    // Increment the Index and reset at the end
-    void Increment()
+    // true if the active pattern changes over time (Update() has work to do)
+    boolean Animated()
     {
-        if (Direction == FORWARD)
+        switch(ActivePattern)
+        {
+            case RAINBOW_CYCLE:
+            case FADE:
+            case SUNUP:
+            case SUNDOWN:
+            case SUNDOWNN:
+            case SUNARC:
+            case COMET:
+            case BREATHE:
+                return true;
+            default:
+                return false;
+        }
+    }
+  
+    // true once an animated pattern has shown its first frame, lastUpdate
+    // belongs to the previous pattern before that
+    boolean Running()
+    {
+        return Started && Animated();
+    }
+  
+    // Set Index and Fraction from the time elapsed since StartTime.
+    // Frames are evaluated at the current time, so a late loop skips frames
+    // but never stretches the pattern. Returns true when a single pass has
+    // ended; repeating patterns start over and never complete.
+    boolean Seek(unsigned long now)
+    {
+        unsigned long elapsed = now - StartTime;
+        boolean complete = false;
+        if (elapsed >= Duration)
         {
-           Index++;
-           if (Index >= TotalSteps)
+            complete = !Repeat;
+            if (Repeat)
+            {
+                // start the next pass, the remainder is already part of it
+                StartTime += (elapsed / Duration) * Duration;
+                elapsed %= Duration;
+            }
+            else
             {
-                Index = 0;
-                if (OnComplete != NULL)
-                {
-                    OnComplete(); // call the completion callback
-                }
+                elapsed = Duration;
             }
         }
+        // scale elapsed to steps directly, a step need not be a whole number of
+        // ms (Breathe: 6000 / 256); very long patterns drop low bits of the
+        // time so that elapsed * TotalSteps and the remainder * 256 fit in 32 bits
+        unsigned long span = Duration;
+        while (span > 0x00FFFFFFUL || span > 0xFFFFFFFFUL / TotalSteps)
+        {
+            span >>= 1;
+            elapsed >>= 1;
+        }
+        if (span == 0) span = 1;
+        unsigned long scaled = elapsed * TotalSteps;
+        uint16_t steps = scaled / span;
+        uint8_t fraction = ((scaled % span) << 8) / span;
+        if (steps >= TotalSteps) // end of a single pass
+        {
+            steps = TotalSteps;
+            fraction = 0;
+        }
+        if (Direction == FORWARD)
+        {
+            Index = steps;
+            Fraction = fraction;
+        }
         else // Direction == REVERSE
         {
-            --Index;
-            if (Index <= 0)
+            Index = TotalSteps - steps;
+            Fraction = 0;
+            if (fraction > 0)
             {
-                Index = TotalSteps-1;
-                if (OnComplete != NULL)
-                {
-                    OnComplete(); // call the completion callback
-                }
+                Index--;
+                Fraction = 256 - fraction;
             }
         }
+        return complete;
     }
     
-    // Reverse pattern direction
+    // Reverse pattern direction, continuing from the current position
     void Reverse()
     {
-        if (Direction == FORWARD)
-        {
-            Direction = REVERSE;
-            Index = TotalSteps-1;
-        }
-        else
-        {
-            Direction = FORWARD;
-            Index = 0;
-        }
+        Direction = (Direction == FORWARD) ? REVERSE : FORWARD;
+        unsigned long elapsed = lastUpdate - StartTime;
+        StartTime = lastUpdate - (Duration - elapsed);
     }
     
     // Initialize for a RainbowCycle
@@ -107,19 +214,19 @@ class NeoPattern : public Adafruit_NeoPixel {
         ActivePattern = RAINBOW_CYCLE;
         Interval = interval;
         TotalSteps = 255;
-        Index = 0;
         Direction = dir;
+        Start(interval * TotalSteps, true);
     }
     
     // Update the Rainbow Cycle Pattern
     void RainbowCycleUpdate()
     {
-        for(int i=0; i< numPixels(); i++)
+        uint8_t index = Index;  // a forward pass ends with Index == TotalSteps
+        for(int i=0; i< Board::LED_COUNT; i++)
         {
-            setPixelColor(i, Wheel(((i * 256 / numPixels()) + Index) & 255));
+            setPixelColor(i, Wheel(((i * 256 / Board::LED_COUNT) + index) & 255));
         }
         show();
-        Increment();
     }
     
     // Initialize for a Fade
@@ -130,80 +237,189 @@ class NeoPattern : public Adafruit_NeoPixel {
         TotalSteps = steps;
         Color1 = color1;
         Color2 = color2;
-        Index = 0;
         Direction = dir;
+        Start(interval * steps, true);
     }
     
     // Update the Fade Pattern
     void FadeUpdate()
     {
         // Calculate linear interpolation between Color1 and Color2
-        // Optimise order of operations to minimize truncation error
-        uint8_t red = ((Red(Color1) * (TotalSteps - Index)) + (Red(Color2) * Index)) / TotalSteps;
-        uint8_t green = ((Green(Color1) * (TotalSteps - Index)) + (Green(Color2) * Index)) / TotalSteps;
-        uint8_t blue = ((Blue(Color1) * (TotalSteps - Index)) + (Blue(Color2) * Index)) / TotalSteps;
+        // at the exact position, including the fraction of the current step
+        // (dividing by TotalSteps instead of total keeps 8 fractional bits)
+        uint32_t total = (uint32_t)TotalSteps << 8;
+        uint32_t pos = ((uint32_t)Index << 8) + Fraction;
+        uint16_t red = ((Red(Color1) * (total - pos)) + (Red(Color2) * pos)) / TotalSteps;
+        uint16_t green = ((Green(Color1) * (total - pos)) + (Green(Color2) * pos)) / TotalSteps;
+        uint16_t blue = ((Blue(Color1) * (total - pos)) + (Blue(Color2) * pos)) / TotalSteps;
         
-        ColorSet(Color(red, green, blue));
-        show();
-        Increment();
+        ColorSet16(red, green, blue);
     }
 
-    void Sunup(unsigned long interval = 100)
+    // Sunrise over the given time in ms, the sun is at full brightness
+    // exactly when the duration has passed; a sunrise that is resumed after
+    // a reset starts elapsed ms into the duration
+    void Sunup(unsigned long duration = 24000, unsigned long interval = SUN_FRAME_INTERVAL, unsigned long elapsed = 0)
     {
         ActivePattern = SUNUP;
         Interval = interval;
         TotalSteps = 240;
-        Index = 1;
         Direction = FORWARD;
+        Start(duration, false, elapsed);
     }
 
-    void Sundown(unsigned long interval = 100)
+    void Sundown(unsigned long duration = 24000, unsigned long interval = SUN_FRAME_INTERVAL)
     {
         ActivePattern = SUNDOWN;
         Interval = interval;
         TotalSteps = 240;
-        Index = 240;
         Direction = REVERSE;
+        Start(duration, false);
     }
 
-    void SundownNight(unsigned long interval = 100)
+    void SundownNight(unsigned long duration = 24000, unsigned long interval = SUN_FRAME_INTERVAL)
     {
         ActivePattern = SUNDOWNN;
         Interval = interval;
         TotalSteps = 240;
-        Index = 240;
         Direction = REVERSE;
+        Start(duration, false);
     }
 
-    void SunUpdate()
+    // Colour of the sun at position 0 - 240 steps, given in 1/256 steps (Index << 8 | Fraction),
+    // in 8.8 fixed point per channel; integer only, it runs every frame
+    void SunColor(uint16_t pos, uint16_t *red, uint16_t *green, uint16_t *blue)
     {
-        uint8_t red;
-        uint8_t green;
-        uint8_t blue;
-
-        if (Index <= 200) {
-          red = float(Index)*1.2;                   // 1.2 - 240 in 200 steps linear
-          green = (pow(5.0, Index/66.7)-0.5)/2.0;   // 0 - 62 logarithmisch
-          blue = (Index<165) ? 0 : (Index-165)/3.5; // 0 - 10, ab 165 linear
+        if (pos <= 200U << 8) {
+          *red = (uint32_t)pos * 6 / 5;                         // 0 - 240 in 200 steps linear
+          uint8_t i = pos >> 10;                                // green from the table, every 4 steps
+          uint16_t g0 = pgm_read_word(&SunGreen[i]);
+          uint16_t g1 = pgm_read_word(&SunGreen[(i < SUN_GREEN_STEPS - 1) ? i + 1 : i]);
+          *green = g0 + (((uint32_t)(g1 - g0) * (pos & 0x3FF)) >> 10);   // 0 - 62 logarithmisch
+          *blue = (pos < 165U << 8) ? 0 : (uint32_t)(pos - (165U << 8)) * 2 / 7;   // 0 - 10, ab 165 linear
         } else {
-          uint16_t a = Index - 200;
-          red = 240.0 + (float(a)*0.375); // *15/40, because 15 steps in 40 rounds -> 240 - 255
-          green = 62.0 + (float(a)*0.5);  // 62 - 82
-          blue = 10.0 + (float(a)*0.5);   // 10 - 30
+          uint16_t a = pos - (200U << 8);
+          *red = (240U << 8) + (uint32_t)a * 3 / 8;   // *15/40, because 15 steps in 40 rounds -> 240 - 255
+          *green = (62U << 8) + a / 2;                // 62 - 82
+          *blue = (10U << 8) + a / 2;                 // 10 - 30
         }
+    }
 
+    void SunUpdate()
+    {
+        // evaluate the curve between two steps for smooth transitions
+        uint16_t red, green, blue;
+        SunColor(((uint16_t)Index << 8) + Fraction, &red, &green, &blue);
+
+#ifdef NEOPATTERN_DEBUG
         Serial.print(Index);
-        Serial.print(") colour: [");
-        Serial.print(red);
-        Serial.print(", ");
-        Serial.print(green);
-        Serial.print(", ");
-        Serial.print(blue);
-        Serial.println("]");
+        Serial.print(F(") colour: ["));
+        Serial.print(red / 256.0);
+        Serial.print(F(", "));
+        Serial.print(green / 256.0);
+        Serial.print(F(", "));
+        Serial.print(blue / 256.0);
+        Serial.println(F("]"));
+#endif
         
-        ColorSet(Color(red, green, blue));
-        show();
-        Increment();
+        ColorSet16(red, green, blue);
+    }
+
+    //------------------------------------------------------------
+    // Per-pixel patterns: each pixel is computed on its own and only
+    // written (and the ring only shown) if its color actually changed.
+    //------------------------------------------------------------
+
+    // Sunrise as an arc that grows from the bottom of the ring to the top,
+    // with the color of the sun curve
+    void SunArc(unsigned long duration = 24000, unsigned long interval = SUN_FRAME_INTERVAL)
+    {
+        ActivePattern = SUNARC;
+        Interval = interval;
+        TotalSteps = 240;
+        Direction = FORWARD;
+        Start(duration, false);
+    }
+
+    void SunArcUpdate()
+    {
+        uint16_t red, green, blue;
+        SunColor(((uint16_t)Index << 8) + Fraction, &red, &green, &blue);
+        // height of the arc, runs past the top so the top pixel gets fully lit
+        uint16_t height = (((uint32_t)Index << 8) + Fraction) * (128 + ARC_EDGE) / ((uint32_t)TotalSteps << 8);
+        boolean changed = false;
+        for (uint16_t i = 0; i < Board::LED_COUNT; i++)
+        {
+            uint8_t angle = PixelAngle(i);
+            uint8_t level = 0;
+            if (height > angle)
+            {
+                uint16_t l = (height - angle) * 256 / ARC_EDGE;
+                level = (l > 255) ? 255 : l;
+            }
+            changed |= SetPixelIfChanged(i, Scale(red >> 8, green >> 8, blue >> 8, level));
+        }
+        if (changed) show();
+    }
+
+    // Comet with a fading tail, running around the ring in the given time per pixel
+    void Comet(uint32_t color, unsigned long interval, direction dir = FORWARD)
+    {
+        ActivePattern = COMET;
+        Interval = interval;
+        TotalSteps = Board::LED_COUNT;
+        Color1 = color;
+        Direction = dir;
+        Start(interval * TotalSteps, true);
+        LastHead = 0;
+        ColorSet(Color(0, 0, 0));
+    }
+
+    void CometUpdate()
+    {
+        uint16_t n = Board::LED_COUNT;
+        uint16_t head = Index % n;
+        boolean changed = false;
+        // clear the pixels the tail has left since the last frame
+        uint16_t moved = (Direction == FORWARD) ? (head + n - LastHead) % n : (LastHead + n - head) % n;
+        if (moved > n - COMET_TAIL - 1) moved = n - COMET_TAIL - 1;
+        for (uint16_t k = COMET_TAIL + 1; k < COMET_TAIL + 1 + moved; k++)
+        {
+            changed |= SetPixelIfChanged(RingOffset(head, -(int16_t)k), 0);
+        }
+        // head and tail, brightest at the head
+        for (uint8_t k = 0; k <= COMET_TAIL; k++)
+        {
+            uint16_t level = (uint16_t)(COMET_TAIL + 1 - k) * 255 / (COMET_TAIL + 1);
+            level = (level * level) >> 8;   // faster fade towards the end of the tail
+            changed |= SetPixelIfChanged(RingOffset(head, -(int16_t)k), Scale(Red(Color1), Green(Color1), Blue(Color1), level));
+        }
+        LastHead = head;
+        if (changed) show();
+    }
+
+    // Slow breathing of the whole ring, the wave starts at the bottom
+    void Breathe(uint32_t color, unsigned long period = 6000, unsigned long interval = SUN_FRAME_INTERVAL)
+    {
+        ActivePattern = BREATHE;
+        Interval = interval;
+        TotalSteps = 256;
+        Color1 = color;
+        Direction = FORWARD;
+        Start(period, true);
+    }
+
+    void BreatheUpdate()
+    {
+        boolean changed = false;
+        for (uint16_t i = 0; i < Board::LED_COUNT; i++)
+        {
+            uint8_t phase = Index - (PixelAngle(i) >> 1);   // pixels at the top follow later
+            uint8_t tri = (phase < 128) ? phase * 2 : (255 - phase) * 2;
+            uint8_t level = 8 + (((uint16_t)tri * tri) >> 8) * 247 / 255;   // never fully dark
+            changed |= SetPixelIfChanged(i, Scale(Red(Color1), Green(Color1), Blue(Color1), level));
+        }
+        if (changed) show();
     }
 
     void Steady(uint32_t color)
@@ -235,13 +451,60 @@ class NeoPattern : public Adafruit_NeoPixel {
     // Set all pixels to a color (synchronously)
     void ColorSet(uint32_t color)
     {
-        for (int i = 0; i < numPixels(); i++)
+        for (int i = 0; i < Board::LED_COUNT; i++)
         {
             setPixelColor(i, color);
         }
         show();
     }
 
+    // Set all pixels to a color with 8 fractional bits per channel (8.8 fixed point).
+    // With Dither enabled the fraction is carried from pixel to pixel around
+    // the ring and from the last pixel into the next frame (error diffusion),
+    // so a level of e.g. 0.25 lights every fourth pixel one step brighter and
+    // the lit pixels move on with every frame. Without Dither the fraction is
+    // cut off.
+    void ColorSet16(uint16_t red, uint16_t green, uint16_t blue)
+    {
+        if (!Dither)
+        {
+            ColorSet(Color(red >> 8, green >> 8, blue >> 8));
+            return;
+        }
+        for (uint16_t i = 0; i < Board::LED_COUNT; i++)
+        {
+            setPixelColor(i, DitherChannel(red, &ErrRed), DitherChannel(green, &ErrGreen), DitherChannel(blue, &ErrBlue));
+        }
+        show();
+    }
+
+    // Angular distance of a pixel from the bottom of the ring (0 - 128)
+    uint8_t PixelAngle(uint16_t i)
+    {
+        if (Board::LED_COUNT == RING_PIXELS)   // resolved at compile time
+        {
+            return pgm_read_byte(&RingAngle[i]);
+        }
+        uint16_t n = Board::LED_COUNT;
+        uint16_t k = (i + n - n / 2) % n;   // other strips: bottom in the middle
+        if (k > n / 2) k = n - k;
+        return k * 256 / n;
+    }
+
+    // Set a pixel only if its color changes, returns true if it did
+    boolean SetPixelIfChanged(uint16_t i, uint32_t color)
+    {
+        if (getPixelColor(i) == color) return false;
+        setPixelColor(i, color);
+        return true;
+    }
+
+    // Color scaled by level / 255
+    uint32_t Scale(uint8_t red, uint8_t green, uint8_t blue, uint8_t level)
+    {
+        return Color(((uint16_t)red * level) / 255, ((uint16_t)green * level) / 255, ((uint16_t)blue * level) / 255);
+    }
+
     // Returns the Red component of a 32-bit color
     uint8_t Red(uint32_t color)
     {
@@ -280,5 +543,45 @@ class NeoPattern : public Adafruit_NeoPixel {
             return Color(WheelPos * 3, 255 - WheelPos * 3, 0);
         }
     }
+
+    private:
+    uint8_t ErrRed, ErrGreen, ErrBlue;  // dithering error carried to the next pixel
+    boolean Repeat;              // restart the pattern after each pass
+    boolean Started;             // StartTime is set with the first Update()
+    uint16_t LastHead;           // head position of the comet in the last frame
+    unsigned long StartOffset;   // time already elapsed when the pattern is started
+
+    // 8 bit output for a 8.8 channel value, the remainder is accumulated in *error
+    uint8_t DitherChannel(uint16_t value, uint8_t *error)
+    {
+        uint8_t out = value >> 8;
+        uint16_t sum = (value & 0xFF) + *error;
+        if (sum >= 256 && out < 255)
+        {
+            out++;
+            sum -= 256;
+        }
+        *error = (sum > 255) ? 255 : sum;
+        return out;
+    }
+
+    // Pixel at the given distance from pixel i, in the direction of the pattern
+    uint16_t RingOffset(uint16_t i, int16_t offset)
+    {
+        uint16_t n = Board::LED_COUNT;
+        if (Direction == REVERSE) offset = -offset;
+        return (i + n + (offset % (int16_t)n)) % n;
+    }
+
+    // Start a new pass of the given length with the next Update()
+    void Start(unsigned long duration, boolean repeat, unsigned long offset = 0)
+    {
+        Duration = duration;
+        Repeat = repeat;
+        StartOffset = offset;
+        Started = false;
+        Index = (Direction == FORWARD) ? 0 : TotalSteps;
+        Fraction = 0;
+    }
 };
 #endif
@@ -0,0 +1,211 @@
+#ifndef __PALETTESTRIP__
+#define __PALETTESTRIP__
+/*
+ * Long LED strip (e.g. 150 - 300 LEDs on the wall) with a palette-indexed frame.
+ *
+ * Adafruit_NeoPixel keeps 3 bytes per pixel, 900 bytes for 300 LEDs, which
+ * does not fit next to the rest of the sketch in 2 KB. Here every pixel only
+ * stores an index into a palette of 16 colors:
+ *
+ *   BITS = 4: the index selects a palette entry      (0.5 byte per pixel)
+ *   BITS = 8: the index runs over the palette as a   (1 byte per pixel)
+ *             gradient, 16 steps between two entries
+ *
+ * The base class gets no pixel buffer at all. show() expands the colors
+ * byte by byte while it sends them: the whole frame goes out in one burst
+ * with interrupts off, and the few cycles a color takes to compute only
+ * stretch the low phase between two bytes, far below the 50 - 300 us of
+ * silence that latch the strip. The bit timing is written for 800 kHz
+ * strips on a 16 MHz AVR (Arduino Uno). setBrightness() has no effect,
+ * the palette sets the brightness.
+ *
+ * A frame takes 30 us per LED (4.5 ms for 150) with interrupts off, like
+ * Adafruit_NeoPixel::show() for a strip of that length. millis() falls
+ * behind by about 1 ms per ms beyond the first, and serial bytes that
+ * arrive meanwhile (console, DFPlayer) can be lost. Update() only sends
+ * when the sunrise level changes, at most 256 frames per sunrise, so the
+ * animation clock drifts by well under a second; the alarm time comes
+ * from the RTC and does not drift.
+ */
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+#include "Board.h"
+
+#if defined(__AVR__) && F_CPU != 16000000L
+#error "PaletteStrip::show() is timed for a 16 MHz AVR"
+#endif
+
+#define PALETTE_SIZE 16
+
+template <class Board, uint8_t BITS>
+class PaletteStrip : public Adafruit_NeoPixel {
+  static_assert(BITS == 4 || BITS == 8, "PaletteStrip supports 4 or 8 bits per pixel");
+
+  public:
+  static const uint8_t BITS_PER_PIXEL = BITS;
+  static const uint16_t FRAME_BYTES = ((uint32_t)Board::WALL_COUNT * BITS + 7) / 8;
+
+  uint8_t palette[PALETTE_SIZE][3];   // r, g, b
+  uint8_t frame[FRAME_BYTES];         // palette index per pixel
+
+  unsigned long StartTime;   // start of the sunrise, set by the first Update()
+  unsigned long Duration;    // length of the sunrise in ms
+  uint8_t Level;             // current sunrise level (0 - 255)
+  boolean Active;            // sunrise is running
+
+  PaletteStrip() : Adafruit_NeoPixel(0, Board::WALL_PIN, Board::WALL_TYPE) {
+    memset(palette, 0, sizeof(palette));
+    memset(frame, 0, sizeof(frame));
+    Active = false;
+    Started = false;
+    Elapsed = 0;
+    Level = 0;
+  }
+
+  void setPalette(uint8_t entry, uint32_t color) {
+    palette[entry][0] = color >> 16;
+    palette[entry][1] = color >> 8;
+    palette[entry][2] = color;
+  }
+
+  void setIndex(uint16_t pixel, uint8_t index) {
+    if (BITS == 4) {
+      uint8_t shift = (pixel & 1) ? 4 : 0;
+      frame[pixel >> 1] = (frame[pixel >> 1] & ~(0x0F << shift)) | ((index & 0x0F) << shift);
+    } else {
+      frame[pixel] = index;
+    }
+  }
+
+  uint8_t getIndex(uint16_t pixel) {
+    if (BITS == 4) {
+      return (frame[pixel >> 1] >> ((pixel & 1) ? 4 : 0)) & 0x0F;
+    }
+    return frame[pixel];
+  }
+
+  void fill(uint8_t index) {
+    memset(frame, (BITS == 4) ? (index & 0x0F) * 0x11 : index, sizeof(frame));
+  }
+
+  // Sunrise over the whole strip: palette 0 - 15 is a ramp from dark to daylight,
+  // pixels at the start of the strip (bottom) are a bit ahead of the others;
+  // a resumed sunrise starts elapsed ms into the duration
+  void Sunrise(unsigned long duration, unsigned long elapsed = 0) {
+    for (uint8_t i = 0; i < PALETTE_SIZE; i++) {
+      uint16_t l = i * 17;   // 0 - 255
+      setPalette(i, Color(l, (l * l) >> 10, (l * l * (uint32_t)l) >> 19));
+    }
+    Duration = duration;
+    Elapsed = elapsed;
+    Level = 0;
+    Active = true;
+    Started = false;
+    fill(0);
+    show();
+  }
+
+  void Off() {
+    Active = false;
+    fill(0);
+    setPalette(0, 0);
+    show();
+  }
+
+  // render and show a new frame if the level changed
+  void Update(unsigned long now) {
+    if (!Active) return;
+    if (!Started) {
+      StartTime = now - Elapsed;
+      Started = true;
+    }
+    unsigned long elapsed = now - StartTime;
+    if (elapsed >= Duration) {
+      elapsed = Duration;
+      Active = false;
+    }
+    uint8_t level = (uint32_t)elapsed * 255 / Duration;
+    if (level == Level && Active) return;
+    Level = level;
+    for (uint16_t p = 0; p < Board::WALL_COUNT; p++) {
+      // up to 1/8 brighter at the bottom
+      uint16_t l = level + (((uint16_t)level * (Board::WALL_COUNT - p)) >> 3) / Board::WALL_COUNT;
+      if (l > 255) l = 255;
+      setIndex(p, (BITS == 4) ? l >> 4 : l);
+    }
+    show();
+  }
+
+  // send the first count pixels, the colors are expanded on the fly
+  void show(uint16_t count = Board::WALL_COUNT) {
+    uint8_t channel[3];   // color channel of the 1st, 2nd and 3rd byte of a pixel
+    channel[rOffset] = 0;
+    channel[gOffset] = 1;
+    channel[bOffset] = 2;
+    while (!canShow());   // the last frame has latched
+    noInterrupts();
+    uint8_t hi = *port | pinMask;
+    uint8_t lo = *port & ~pinMask;
+    for (uint16_t p = 0; p < count; p++) {
+      uint8_t index = getIndex(p);
+      sendByte(expand(index, channel[0]), hi, lo);
+      sendByte(expand(index, channel[1]), hi, lo);
+      sendByte(expand(index, channel[2]), hi, lo);
+    }
+    interrupts();
+    endTime = micros();
+  }
+
+  // RAM needed for count pixels: index frame and palette
+  static uint16_t ramBytes(uint16_t count) {
+    return ((uint32_t)count * BITS + 7) / 8 + sizeof(palette);
+  }
+
+  private:
+  boolean Started;           // StartTime is valid
+  unsigned long Elapsed;     // time already elapsed when the sunrise is started
+
+  // channel c (0 = red, 1 = green, 2 = blue) of the color of a palette index
+  uint8_t expand(uint8_t index, uint8_t c) {
+    if (BITS == 4) {
+      return palette[index][c];
+    }
+    uint8_t e = index >> 4;
+    uint8_t f = index & 0x0F;
+    uint8_t n = (e < PALETTE_SIZE - 1) ? e + 1 : e;
+    return palette[e][c] + ((((int16_t)palette[n][c] - palette[e][c]) * f) >> 4);
+  }
+
+  // one byte, MSB first, 20 cycles (1.25 us) per bit; the line is low on return
+  void sendByte(uint8_t b, uint8_t hi, uint8_t lo) {
+    uint8_t next = lo;
+    uint8_t bit = 8;
+    asm volatile(
+     "1:"                        "\n\t" // Clk  Pseudocode    (T =  0)
+      "st   %a[port], %[hi]"     "\n\t" // 2    PORT = hi     (T =  2)
+      "sbrc %[byte], 7"          "\n\t" // 1-2  if (b & 128)
+       "mov  %[next], %[hi]"     "\n\t" // 0-1   next = hi    (T =  4)
+      "dec  %[bit]"              "\n\t" // 1    bit--         (T =  5)
+      "st   %a[port], %[next]"   "\n\t" // 2    PORT = next   (T =  7)
+      "mov  %[next], %[lo]"      "\n\t" // 1    next = lo     (T =  8)
+      "breq 2f"                  "\n\t" // 1-2  if (bit == 0) -> last bit
+      "rol  %[byte]"             "\n\t" // 1    b <<= 1       (T = 10)
+      "rjmp .+0"                 "\n\t" // 2    nop nop       (T = 12)
+      "nop"                      "\n\t" // 1    nop           (T = 13)
+      "st   %a[port], %[lo]"     "\n\t" // 2    PORT = lo     (T = 15)
+      "nop"                      "\n\t" // 1    nop           (T = 16)
+      "rjmp .+0"                 "\n\t" // 2    nop nop       (T = 18)
+      "rjmp 1b"                  "\n\t" // 2    -> next bit   (T = 20)
+     "2:"                        "\n\t" //                    (T = 10)
+      "rjmp .+0"                 "\n\t" // 2    nop nop       (T = 12)
+      "nop"                      "\n\t" // 1    nop           (T = 13)
+      "st   %a[port], %[lo]"     "\n"   // 2    PORT = lo     (T = 15)
+      : [byte] "+r" (b),
+        [bit]  "+r" (bit),
+        [next] "+r" (next)
+      : [port] "e" (port),
+        [hi]   "r" (hi),
+        [lo]   "r" (lo));
+  }
+};
+#endif
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Turn a dump of the flight recorder into a readable timeline.
+
+Send "D" on the serial console, save the output and run
+
+    python3 tools/decode_trace.py dump.txt
+
+Lines that do not start with "trace," are ignored, so a whole serial log can
+be passed. The record layout is the one of TraceRecord in FlightRecorder.h.
+"""
+import datetime
+import struct
+import sys
+
+EPOCH = datetime.datetime(2000, 1, 1)
+BOOT_SECS = 365 * 86400   # smaller times are seconds since boot (RTC not read yet)
+
+# EventType in EventQueue.h, TraceType in FlightRecorder.h
+TYPES = {
+    0x01: "Vor-Alarm (Sonnenaufgang)",
+    0x02: "Alarm",
+    0x03: "Nach-Alarm",
+    0x04: "Muster fertig",
+    0x05: "Karte gelesen",
+    0x06: "MP3 spielt",
+    0x07: "MP3 fertig",
+    0x08: "MP3 Fehler",
+    0x80: "Reset",
+    0x81: "Loop zu langsam",
+}
+
+# MFRC522::StatusCode
+CARD_STATUS = {
+    0x00: "OK", 0x01: "ERROR", 0x02: "COLLISION", 0x03: "TIMEOUT",
+    0x04: "NO_ROOM", 0x05: "INTERNAL_ERROR", 0x06: "INVALID",
+    0x07: "CRC_WRONG", 0xFF: "MIFARE_NACK",
+}
+
+# DfMp3_Error
+MP3_ERROR = {
+    0x01: "Busy", 0x02: "Sleeping", 0x03: "SerialWrongStack",
+    0x04: "CheckSumNotMatch", 0x05: "FileIndexOut", 0x06: "FileMismatch",
+    0x07: "Advertise", 0x81: "RxTimeout", 0xFF: "General",
+}
+
+# MCUSR
+RESET_FLAGS = ((0x01, "Power-on"), (0x02, "Reset-Taste"), (0x04, "Brown-out"), (0x08, "Watchdog"))
+
+
+def describe(kind, arg):
+    if kind == 0x05:
+        return CARD_STATUS.get(arg, "status %d" % arg)
+    if kind == 0x08:
+        return MP3_ERROR.get(arg, "code %d" % arg)
+    if kind in (0x01, 0x02):
+        return "fortgesetzt, %d s nach Beginn" % arg if arg else ""
+    if kind in (0x06, 0x07):
+        return "Track %d" % arg if arg else "Ansage"
+    if kind == 0x80:
+        flags = [name for bit, name in RESET_FLAGS if arg & bit]
+        return ", ".join(flags) if flags else "unbekannt"
+    if kind == 0x81:
+        return "%d ms" % arg
+    return ""
+
+
+def timestamp(secs):
+    if secs < BOOT_SECS:
+        return "+%ds nach Start" % secs
+    return (EPOCH + datetime.timedelta(seconds=secs)).strftime("%Y-%m-%d %H:%M:%S")
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    for line in source:
+        line = line.strip()
+        if not line.startswith("trace,"):
+            continue
+        field = line.split(",")[1]
+        if field == "dropped":
+            print("(%s Einträge verloren)" % line.split(",")[2])
+            continue
+        try:
+            seq, kind, arg, secs = struct.unpack("<BBHI", bytes.fromhex(field))
+        except ValueError:
+            continue
+        name = TYPES.get(kind, "Typ 0x%02X" % kind)
+        print("%-22s %-26s %s" % (timestamp(secs), name, describe(kind, arg)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Build-time SRAM footprint of the sketch: size of every object in .data and
+# .bss, largest first, in the same "mem,<name>,<bytes>" format as the runtime
+# report of MemStats.h. Heap and stack usage are only known at runtime.
+#
+#   tools/mem_footprint.sh [fqbn]        (default arduino:avr:uno)
+#
+# Needs arduino-cli; avr-nm and avr-size are taken from PATH or from the
+# avr-gcc that comes with the Arduino AVR core.
+set -e
+FQBN=${1:-arduino:avr:uno}
+SKETCH_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+arduino-cli compile --fqbn "$FQBN" --output-dir "$BUILD" "$SKETCH_DIR" >/dev/null
+ELF=$(ls "$BUILD"/*.elf | head -n 1)
+
+TOOLS=$(ls -d "$HOME"/.arduino15/packages/arduino/tools/avr-gcc/*/bin 2>/dev/null | tail -n 1)
+NM=$(command -v avr-nm || echo "$TOOLS/avr-nm")
+SIZE=$(command -v avr-size || echo "$TOOLS/avr-size")
+
+# symbol types b/B (.bss) and d/D (.data) are the ones that take SRAM
+"$NM" -C -S -t d --size-sort -r "$ELF" | awk '$3 ~ /^[bBdD]$/ {
+  name = $4; for (i = 5; i <= NF; i++) name = name " " $i
+  printf "mem,%s,%d\n", name, $2
+}'
+"$SIZE" -A "$ELF" | awk '$1 == ".data" || $1 == ".bss" || $1 == ".text" { printf "mem,%s,%d\n", substr($1, 2), $2 }'
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Flash and static RAM of the sketch before and after a change, for both
+# display variants, as "size,<variant>,<flash|ram>,<before>,<after>,<delta>".
+#
+#   tools/size_compare.sh [before-rev] [fqbn]   (default HEAD, arduino:avr:uno)
+#
+# "after" is the working tree. The small variant is built by switching the
+# Board typedef to WeckerBoardSmallDisplay (or, in revisions before Board.h,
+# the oledtype argument of the Clock constructor to 0). Needs git and
+# arduino-cli, avr-size is found like in mem_footprint.sh.
+set -e
+BEFORE=${1:-HEAD}
+FQBN=${2:-arduino:avr:uno}
+REPO=$(cd "$(dirname "$0")/.." && pwd)
+SKETCH=wecker_20190924_2
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+TOOLS=$(ls -d "$HOME"/.arduino15/packages/arduino/tools/avr-gcc/*/bin 2>/dev/null | tail -n 1)
+SIZE=$(command -v avr-size || echo "$TOOLS/avr-size")
+
+# sources of a revision (or of the working tree for "after") in $WORK/<tag>/$SKETCH
+checkout() {
+  mkdir -p "$WORK/$1/$SKETCH"
+  if [ "$2" = "after" ]; then
+    cp "$REPO"/*.ino "$REPO"/*.h "$WORK/$1/$SKETCH/"
+  else
+    git -C "$REPO" archive "$2" | tar -x -C "$WORK/$1/$SKETCH"
+  fi
+  rm -f "$WORK/$1/$SKETCH"/rfid_write_*.ino   # separate sketch for the card writer
+}
+
+# "<flash> <ram>" of the sketch in $WORK/<tag>
+measure() {
+  arduino-cli compile --fqbn "$FQBN" --output-dir "$WORK/$1/build" "$WORK/$1/$SKETCH" >/dev/null
+  "$SIZE" -A "$WORK/$1/build/$SKETCH.ino.elf" | awk '
+    $1 == ".text" { text = $2 } $1 == ".data" { data = $2 } $1 == ".bss" { bss = $2 }
+    END { print text + data, data + bss }'
+}
+
+for variant in big small; do
+  for rev in before after; do
+    tag=$variant-$rev
+    if [ "$rev" = "before" ]; then checkout "$tag" "$BEFORE"; else checkout "$tag" after; fi
+    if [ "$variant" = "small" ]; then
+      ino=$WORK/$tag/$SKETCH/$SKETCH.ino
+      sed -e 's/^typedef WeckerBoard Board;/typedef WeckerBoardSmallDisplay Board;/' \
+          -e 's/^Clock clock(1,/Clock clock(0,/' "$ino" > "$ino.tmp" && mv "$ino.tmp" "$ino"
+    fi
+    measure "$tag" > "$WORK/$tag.size"
+  done
+  paste "$WORK/$variant-before.size" "$WORK/$variant-after.size" | awk -v v="$variant" '{
+    printf "size,%s,flash,%d,%d,%+d\n", v, $1, $3, $3 - $1
+    printf "size,%s,ram,%d,%d,%+d\n", v, $2, $4, $4 - $2
+  }'
+done
@@ -1,38 +1,127 @@
+//#define WECKER_BENCH             // replay a scripted scenario on simulated time, see Bench.h
+#define BENCH_SCENARIO  BENCH_NIGHT
+//#define WECKER_MEMSTATS          // print the SRAM report after setup, see MemStats.h
+//#define WECKER_WALL              // long LED strip on the wall, see PaletteStrip.h
+
+#include "Bench.h"
+#include "Board.h"
 #include "Cardreader.h"
 #include "Clock.h"
+#include "Console.h"
+#include "EventQueue.h"
+#include "FlightRecorder.h"
+#include "I2cBus.h"
+#include "MemStats.h"
 #include "Mp3Player.h"
 #include "NeoPattern.h"
+#include "PaletteStrip.h"
+
+typedef WeckerBoard Board;         // pins and display type, see Board.h
+typedef Cardreader<Board> Reader;
+typedef NeoPattern<Board> Ring;
+typedef PaletteStrip<Board, 4> Wall;   // 4 bits per pixel, 75 bytes for 150 LEDs
 
-#define RST_PIN         9          // RFID
-#define SS_PIN         10          // RFID
-#define RX_PIN          2          // MP3
-#define TX_PIN          3          // MP3
-#define busyPin         4          // MP3
-#define LED_PIN         8          // LED
+#define MP3_BOOT_TIME 3000         // ms the DFPlayer needs after begin() before it plays
+#define CLOCK_INTERVAL 250         // ms between two RTC reads
+#define CARD_INTERVAL  250         // ms between two polls of the RFID reader
+#define LOOP_OVERRUN   50          // ms after which a loop() iteration is traced
 
 void RaiseAlarm();
 void NachAlarm();
 void VorAlarm();
 void SunriseComplete();
+void handleCard(Reader::nfcTagObject &card);
+void memReport();
+void pollCard();
+void bootStep();
+void dispatchEvents();
+void onAlarmPre(uint16_t elapsed);
+void onAlarm();
+void onAlarmPost();
+void onPatternComplete(uint16_t completed);
+void setAlarm(uint8_t mode, uint8_t sound, uint8_t hours, uint8_t minutes);
+void playScene(uint8_t pattern, uint32_t color);
+void consoleCommand(char command, uint8_t argc, const int16_t *args);
+void dumpStats(Print &out);
+#ifdef WECKER_BENCH
+void benchSetup(BenchScenario scenario);
+void benchLoop();
+#endif
+#if defined(WECKER_BENCH) && defined(WECKER_WALL)
+unsigned long wallShowMicros(uint16_t n);
+void benchWallSweep();
+#endif
+
+EventQueue events;                    // events posted by the callbacks below
+FlightRecorder trace;                 // events kept in the EEPROM, see FlightRecorder.h
+I2cBus i2c;                           // transfers of RTC and display, see I2cBus.h
+Reader mfrc522;                       // Create MFRC522 instance
+Mp3Player mp3(Board::MP3_RX_PIN, Board::MP3_TX_PIN, Board::MP3_BUSY_PIN);        // create DFMiniMp3 instance
+Clock<Board> clock(false, &VorAlarm, &RaiseAlarm, &NachAlarm); // sync = false, alarm callbacks
+Ring ledring(&SunriseComplete);       // callback (sunrise)
+Console console(Serial, &consoleCommand);   // serial commands, see Console.h
+#ifdef WECKER_WALL
+Wall wall;                            // sunrise on the wall strip
+#endif
+#ifdef WECKER_BENCH
+Bench bench;
+#endif
+
+unsigned long lastClockUpdate = 0;
+unsigned long lastCardPoll = 0;
 
-Cardreader mfrc522(SS_PIN, RST_PIN);  // Create MFRC522 instance
-Mp3Player mp3(RX_PIN, TX_PIN, busyPin);        // create DFMiniMp3 instance
-Clock clock(1, false, &VorAlarm, &RaiseAlarm, &NachAlarm); // type = 1, sync = false, alarm callbacks
-NeoPattern ledring(24, LED_PIN, NEO_GRB + NEO_KHZ800, &SunriseComplete); // number LEDS, PIN, type, callback (sunrise)
+// peripherals that are brought up by bootStep() after the clock is shown
+enum BootStage : byte {
+  BOOT_RFID,
+  BOOT_MP3,
+  BOOT_SOUND,
+  BOOT_DONE
+};
+BootStage bootStage = BOOT_RFID;
+boolean alarmPlaylist = false;  // alarm music is playing, continue with the next track
+unsigned long bootDisplayMs;    // time until the clock was shown
+unsigned long bootReadyMs;      // time until all peripherals were up
+unsigned long mp3StartMs;
+uint8_t resetFlags __attribute__((section(".noinit")));   // MCUSR of the last reset, 0 if unknown
+
+// Runs in .init3, after the stack is set up and before .data/.bss are
+// initialized (see the avr-libc notes on MCUSR). Without a bootloader MCUSR
+// still holds the flags. Optiboot clears MCUSR; version 6 and later pass
+// its value in r2, older ones (the stock Uno bootloader) leave whatever was
+// in r2, so r2 only counts if it looks like MCUSR (bits 0 - 3) and the
+// cause is logged as unknown otherwise.
+void saveResetFlags() __attribute__((naked, used, section(".init3")));
+void saveResetFlags() {
+  uint8_t passed;
+  asm volatile("mov %0, r2" : "=r" (passed));
+  uint8_t flags = MCUSR;
+  if (flags == 0 && (passed & 0xF0) == 0) flags = passed;
+  resetFlags = flags;
+  MCUSR = 0;
+}
 
 void setup() {
+  MemStats::paint();    // mark free RAM to find the stack high-water mark later
 	Serial.begin(115200);		// Initialize serial communications with the PC (baud rate != 9600, because that is used by mp3 player)
-	while (!Serial);		// Do nothing if no serial port is opened (added for Arduinos based on ATMEGA32U4)
 
-  Serial.println("Init LED ring");
+  // display and RTC first, so the time is shown right after power-up
+  clock.begin();
+  bootDisplayMs = millis();
+
+  trace.begin();
+  if (clock.hasRtc()) trace.sync(clock.now().secondstime(), millis());
+  trace.log(TR_BOOT, resetFlags);   // why the board was reset
+
+  Serial.println(F("Init LED ring"));
   ledring.begin();
+  ledring.Dither = true;    // smooth start of the sunrise
   ledring.Off();
-  
-	SPI.begin();			// Init SPI bus
-	mfrc522.PCD_Init();		// Init MFRC522
-	mfrc522.PCD_DumpVersionToSerial();	// Show details of PCD - MFRC522 Card Reader details
+#ifdef WECKER_WALL
+  wall.begin();
+  wall.Off();
+#endif
 
-  clock.begin();
+  // card reader and mp3 player follow in bootStep(), one per loop iteration
   //DateTime now = clock.now();
   /*Serial.print("Now: ");
   Serial.print(now.hour());
@@ -41,23 +130,52 @@ void setup() {
   /*clock.setAlarmTime(now.hour(), now.minute() + 1, now.hour(), now.minute() + 2, now.hour(), now.minute() + 3);
   clock.enableAlarm();*/
 
-  mp3.begin();
-
-  delay(3000);
-  mp3.playCommandSound(Mp3Com_Start);
-
-  //ledring.Sunup(100);
+  //ledring.Sunup(24000);
+#ifdef WECKER_MEMSTATS
+  memReport();
+#endif
+#ifdef WECKER_BENCH
+  benchSetup(BENCH_SCENARIO);
+#endif
 }
 
 void loop() {
+#ifdef WECKER_BENCH
+  benchLoop();
+  return;
+#endif
+  unsigned long ms = millis();
+  if (bootStage != BOOT_DONE) bootStep();
   mp3.loop();
-  clock.update(); // alarms will be raised in callback
-  ledring.Update(); 
+  console.update();
+  i2c.nextSlot();
+  if (ms - lastClockUpdate >= CLOCK_INTERVAL && clock.hasRtc()) {
+    lastClockUpdate = ms;
+    DateTime now = clock.now();
+    trace.sync(now.secondstime(), ms);
+    clock.update(now); // alarms will be raised in callback
+  }
+  if (!i2c.busy()) clock.drawSlice();   // the RTC read goes first, the display waits for the next iteration
+  ledring.Update(ms);   // no delay in the loop, the sunrise runs with up to 50 frames per second
+#ifdef WECKER_WALL
+  wall.Update(ms);
+#endif
+
+  if (ms - lastCardPoll >= CARD_INTERVAL) {
+    lastCardPoll = ms;
+    pollCard();
+  }
+  dispatchEvents();
+  trace.loop(ms);
 
-  delay(500);
+  unsigned long took = millis() - ms;
+  if (took > LOOP_OVERRUN) trace.log(TR_OVERRUN, took);
+}
 
-  /*********************************************/
+void pollCard() {
+  if (!mfrc522.present) return;   // not initialised yet or missing
 	// Reset the loop if no new card present on the sensor/reader. This saves the entire process when idle.
+	BENCH_COUNT(spiBytes, BENCH_SPI_CARD_POLL);
 	if ( ! mfrc522.PICC_IsNewCardPresent()) {
 		return;
 	}
@@ -67,155 +185,519 @@ void loop() {
 	}
  
 	// read card
-  if (mfrc522.readCard(&(mfrc522.myCard)) == true) {
-    
-    // Spezial
-    //Serial.println(mfrc522.myCard.id);
-    if (mfrc522.myCard.id == 483888059) {
-      Serial.println("Spezial-Anweisung!");
-      DateTime now = clock.now();
-      if (clock.setAlarmTime(now.hour(), now.minute() + 1, now.hour(), now.minute() + 3, now.hour(), now.minute() + 5)) {
-        clock.enableAlarm();
-        //ledring.Off();
+  events.post(EV_CARD_READ, mfrc522.readCard(&(mfrc522.myCard)));
+  
+  // Halt PICC
+    mfrc522.PICC_HaltA();
+    // Stop encryption on PCD
+    mfrc522.PCD_StopCrypto1();
+}
+
+// initialise the next peripheral, a missing one is reported and skipped
+void bootStep() {
+  switch (bootStage) {
+    case BOOT_RFID:
+      SPI.begin();			// Init SPI bus
+      if (!mfrc522.begin()) {
+        Serial.println(F("Kartenleser nicht gefunden"));
+      }
+      bootStage = BOOT_MP3;
+      break;
+    case BOOT_MP3:
+      mp3.begin();
+      mp3StartMs = millis();
+      bootStage = BOOT_SOUND;
+      break;
+    case BOOT_SOUND:
+      if (millis() - mp3StartMs < MP3_BOOT_TIME) break;   // wait without blocking the loop
+      if (alarmPlaylist) {
+        // reset while the alarm was ringing, continue with the music
+        mp3.setFolder(2);
+        mp3.play();
+      } else {
+        mp3.playCommandSound(Mp3Com_Start);
       }
+      bootReadyMs = millis();
+      Serial.print(F("boot,display_ms,"));
+      Serial.println(bootDisplayMs);
+      Serial.print(F("boot,ready_ms,"));
+      Serial.println(bootReadyMs);
+      bootStage = BOOT_DONE;
+      break;
+    default:
+      break;
+  }
+}
+
+// execute the commands stored on a card
+void handleCard(Reader::nfcTagObject &card) {
+  // Spezial
+  //Serial.println(card.id);
+  if (card.id == 483888059 && clock.hasRtc()) {
+    Serial.println(F("Spezial-Anweisung!"));
+    DateTime now = clock.now();
+    if (clock.setAlarmTime(now.hour(), now.minute() + 1, now.hour(), now.minute() + 3, now.hour(), now.minute() + 5)) {
+      clock.enableAlarm();
+      //ledring.Off();
     }
+  }
+  
+  if (card.cookie == 322417480) {
+    Serial.println(F("bekannte Karte"));
+    mp3.playCommandSound(Mp3Com_KnownCard);
+
+    //************** send commands to clock and leds *********************//
+    setAlarm(card.wakeup_mode, card.wakeup_sound, card.wakeup_hours, card.wakeup_minutes);
+    playScene(card.light_pattern, Ring::Color(card.light_r, card.light_g, card.light_b));
+  } else {
+    Serial.print(F("unbekannte Karte (Cookie "));
+    Serial.print(card.cookie);
+    Serial.println(F(")"));
+    mp3.playCommandSound(Mp3Com_UnknownCard);
+  }
+}
+
+//------------------------------------------------------------
+//Command handlers - shared by card reader and serial console
+//------------------------------------------------------------
+
+// alarm on/off, sound on/off and alarm time, 99 leaves a setting unchanged
+void setAlarm(uint8_t mode, uint8_t sound, uint8_t hours, uint8_t minutes) {
+  // alarm sound
+  switch (sound) {
+    case 0:
+      clock.disableMusic();
+      break;
+    case 1:
+      clock.enableMusic();
+      break;
+    case 99:
+    default:
+      // do nothing
+      break;
+  }
+  // alarm time
+  if (hours < 24 && minutes < 60) {
+    clock.SetAlarmTime(hours, minutes, 1800, 1800);
     
-    if (mfrc522.myCard.cookie == 322417480) {
-      Serial.println("bekannte Karte");
-      mp3.playCommandSound(Mp3Com_KnownCard);
-
-      //************** send commands to clock and leds *********************//
-      // alarm sound
-      switch (mfrc522.myCard.wakeup_sound) {
-        case 0:
-          clock.disableMusic();
-          break;
-        case 1:
-          clock.enableMusic();
-          break;
-        case 99:
-        default:
-          // do nothing
-          break;
+  } else if (hours < 24) {
+    // change only hours
+    clock.SetAlarmTime(hours, clock.alarm1min, 1800, 1800);
+    
+  } else if (minutes < 60) {
+    // only change minutes
+    clock.SetAlarmTime(clock.alarm1hour, minutes, 1800, 1800);
+  }
+  // switch alarm on/off
+  switch (mode) {
+    case WKMOD_OFF:
+      clock.disableAlarm();
+      break;
+    case WKMOD_ON:
+      clock.enableAlarm();
+      break;
+    case WKMOD_UNCHANGED:
+    default:
+      // do nothing
+      break;
+  }
+}
+
+// light pattern (PATTERN) with color for the patterns that use one
+void playScene(uint8_t pattern, uint32_t color) {
+  switch (pattern) {
+    case PAT_OFF:
+      ledring.Off();
+      break;
+    /*case PAT_SNRS:
+      ledring.Sunup(24000);
+      break;*/
+    case PAT_SNDWN:
+      ledring.Sundown(120000);  // TODO: duration?
+      clock.showSunSymbol(true);
+      clock.showStarSymbol(false);
+      break;
+    case PAT_SNDWN_SLP:
+      ledring.SundownNight(120000);  // TODO
+      clock.showSunSymbol(true);
+      clock.showStarSymbol(false);
+      break;
+    case PAT_RAINBOW:
+      ledring.RainbowCycle(300);
+      clock.showSunSymbol(false);
+      clock.showStarSymbol(true);
+      break;
+    case PAT_MOOD_RND:
+      ledring.Steady(ledring.Wheel(random(255)));
+      clock.showSunSymbol(false);
+      clock.showStarSymbol(true);
+      break;
+    case PAT_MOOD_COL:
+      ledring.Steady(color);
+      clock.showSunSymbol(false);
+      clock.showStarSymbol(true);
+      break;
+    case PAT_SUNARC:
+      ledring.SunArc(120000);
+      clock.showSunSymbol(true);
+      clock.showStarSymbol(false);
+      break;
+    case PAT_COMET:
+      ledring.Comet(color, 80);
+      clock.showSunSymbol(false);
+      clock.showStarSymbol(true);
+      break;
+    case PAT_BREATHE:
+      ledring.Breathe(color);
+      clock.showSunSymbol(false);
+      clock.showStarSymbol(true);
+      break;
+    case PAT_UNCHANGED:
+    default:
+      // do nothing
+      ledring.Off();
+      break;
+  }
+}
+
+// called by the console for every complete line
+void consoleCommand(char command, uint8_t argc, const int16_t *args) {
+  switch (command) {
+    case 'A':   // A hh:mm | A 0 | A 1
+      if (argc >= 2) {
+        setAlarm(WKMOD_ON, WSND_UNCHANGED, min(args[0], 99), min(args[1], 99));
+      } else if (argc == 1) {
+        setAlarm(args[0] ? WKMOD_ON : WKMOD_OFF, WSND_UNCHANGED, 99, 99);
       }
-      // alarm time
-      if (mfrc522.myCard.wakeup_hours < 24 && mfrc522.myCard.wakeup_minutes < 60) {
-        clock.SetAlarmTime(mfrc522.myCard.wakeup_hours, mfrc522.myCard.wakeup_minutes, 1800, 1800);
-        
-      } else if (mfrc522.myCard.wakeup_hours < 24) {
-        // change only hours
-        uint8_t minutes = clock.alarm1min;
-        clock.SetAlarmTime(mfrc522.myCard.wakeup_hours, minutes, 1800, 1800);
-        
-      } else if (mfrc522.myCard.wakeup_minutes < 60) {
-        // only change minutes
-        uint8_t hours = clock.alarm1hour;
-        clock.SetAlarmTime(hours, mfrc522.myCard.wakeup_minutes, 1800, 1800);
+      break;
+    case 'N':   // N hh:mm hh:mm - display dimmed from bedtime, off from deep night
+      if (argc >= 4 && args[0] < 24 && args[1] < 60 && args[2] < 24 && args[3] < 60) {
+        clock.bedHour = args[0];
+        clock.bedMin = args[1];
+        clock.nightHour = args[2];
+        clock.nightMin = args[3];
       }
-      // switch alarm on/off
-      switch (mfrc522.myCard.wakeup_mode) {
-        case WKMOD_OFF:
-          clock.disableAlarm();
-          break;
-        case WKMOD_ON:
-          clock.enableAlarm();
-          break;
-        case WKMOD_UNCHANGED:
-        default:
-          // do nothing
-          break;
+      break;
+    case 'P':   // P pattern [r g b]
+      if (argc >= 1) {
+        uint32_t color = (argc >= 4) ? Ring::Color(min(args[1], 255), min(args[2], 255), min(args[3], 255)) : Ring::Color(255, 82, 30);
+        playScene(min(args[0], 99), color);
       }
-
-      // light
-      switch (mfrc522.myCard.light_pattern) {
-        case PAT_OFF:
-          ledring.Off();
-          break;
-        /*case PAT_SNRS:
-          ledring.Sunup(100);
-          break;*/
-        case PAT_SNDWN:
-          ledring.Sundown(500);  // TODO: interval?
-          clock.showSunSymbol(true);
-          clock.showStarSymbol(false);
-          break;
-        case PAT_SNDWN_SLP:
-          ledring.SundownNight(500);  // TODO
-          clock.showSunSymbol(true);
-          clock.showStarSymbol(false);
-          break;
-        case PAT_RAINBOW:
-          ledring.RainbowCycle(300);
-          clock.showSunSymbol(false);
-          clock.showStarSymbol(true);
-          break;
-        case PAT_MOOD_RND:
-          ledring.Steady(ledring.Wheel(random(255)));
-          clock.showSunSymbol(false);
-          clock.showStarSymbol(true);
-          break;
-        case PAT_MOOD_COL:
-          ledring.Steady(NeoPattern::Color(mfrc522.myCard.light_r, mfrc522.myCard.light_g, mfrc522.myCard.light_b));
-          clock.showSunSymbol(false);
-          clock.showStarSymbol(true);
-          break;
-        case PAT_UNCHANGED:
-        default:
-          // do nothing
-          ledring.Off();
-          break;
+      break;
+    case 'D':
+      trace.dump(console.output());
+      break;
+    case 'S':
+      dumpStats(console.output());
+      break;
+    case 'T':   // T hh:mm[:ss]
+      if (argc >= 2 && args[0] < 24 && args[1] < 60 && (argc < 3 || args[2] < 60)) {
+        clock.setTime(args[0], args[1], (argc >= 3) ? args[2] : 0);
       }
-      
-      
-    } else {
-      Serial.print("unbekannte Karte (Cookie ");
-      Serial.print(mfrc522.myCard.cookie);
-      Serial.println(")");
-      mp3.playCommandSound(Mp3Com_UnknownCard);
-    }
+      break;
+    default:
+      console.output().println(F("Befehle: A hh:mm | A 0/1 | D | N hh:mm hh:mm | P muster [r g b] | S | T hh:mm[:ss]"));
+      break;
   }
-  
-  // Halt PICC
-    mfrc522.PICC_HaltA();
-    // Stop encryption on PCD
-    mfrc522.PCD_StopCrypto1();
+}
+
+void dumpStats(Print &out) {
+  out.print(F("stat,alarm,"));
+  out.print(clock.alarm1hour);
+  out.print(':');
+  out.print(clock.alarm1min);
+  out.print(',');
+  out.println(clock.alarm ? F("on") : F("off"));
+  out.print(F("stat,music,"));
+  out.println(clock.alarmMusic ? F("on") : F("off"));
+  out.print(F("stat,display,"));
+  out.println(clock.getDisplayMode());
+  out.print(F("stat,pattern,"));
+  out.println(ledring.ActivePattern);
+  out.print(F("stat,mp3_playing,"));
+  out.println(mp3.isPlaying());
+  out.print(F("stat,mp3_play_ms,"));
+  out.println(mp3.playDuration());
+  out.print(F("stat,events_dropped,"));
+  out.println(events.dropped);
+  out.print(F("stat,trace_dropped,"));
+  out.println(trace.dropped);
+  i2c.report(out);
+  out.print(F("stat,uptime,"));
+  out.println(millis());
+  out.print(F("stat,boot_display_ms,"));
+  out.println(bootDisplayMs);
+  out.print(F("stat,boot_ready_ms,"));
+  out.println(bootReadyMs);
+  memReport();
 }
 
 //------------------------------------------------------------
-//Callback Routines - get called on completion of a routine
+//Callback Routines - get called on completion of a routine,
+//they only post an event, the work is done in dispatchEvents()
 //------------------------------------------------------------
 
-// Clock Callback
+// Clock Callback, arg: seconds already passed in the phase (not 0 when resumed after a reset)
 void RaiseAlarm() {
-  Serial.println("     ALARM !!!!   ");
+  events.post(EV_ALARM, clock.getSecsInPhase());
+}
+void NachAlarm() {
+  events.post(EV_ALARM_POST);
+}
+void VorAlarm() {
+  events.post(EV_ALARM_PRE, clock.getSecsInPhase());
+}
+// NeoPattern Callback
+void SunriseComplete() {
+  events.post(EV_PATTERN_COMPLETE, ledring.ActivePattern);
+}
+
+//------------------------------------------------------------
+//Event handlers - called once per loop for all queued events
+//------------------------------------------------------------
+void dispatchEvents() {
+  Event event;
+  for (uint8_t i = 0; i < EVENT_QUEUE_SIZE && events.pop(&event); i++) {
+    if (event.type == EV_CARD_READ) {
+      trace.log(event.type, mfrc522.lastStatus());
+    } else if (event.type != EV_PATTERN_COMPLETE) {   // repeating patterns would flood the trace
+      trace.log(event.type, event.arg);
+    }
+    switch (event.type) {
+      case EV_ALARM_PRE:
+        onAlarmPre(event.arg);
+        break;
+      case EV_ALARM:
+        onAlarm();
+        break;
+      case EV_ALARM_POST:
+        onAlarmPost();
+        break;
+      case EV_PATTERN_COMPLETE:
+        onPatternComplete(event.arg);
+        break;
+      case EV_CARD_READ:
+        clock.wakeDisplay();
+        if (event.arg) handleCard(mfrc522.myCard);
+        break;
+      case EV_MP3_FINISHED:
+        if (alarmPlaylist) {
+          if (event.arg) {
+            mp3.next();   // alarm track finished
+          } else {
+            mp3.play();   // a card beep cut the alarm track off, play it again
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void onAlarm() {
+  Serial.println(F("     ALARM !!!!   "));
   // mp3 an
   if (clock.alarmMusic) {
     //mp3.begin();
-    mp3.setFolder(2);
-    mp3.play();
+    alarmPlaylist = true;
+    if (bootStage == BOOT_DONE) {   // otherwise bootStep() starts the music
+      mp3.setFolder(2);
+      mp3.play();
+    }
   }
   // Licht umstellen auf Dauer-an
-  ledring.Steady(NeoPattern::Color(255,82,30));
+  ledring.Steady(Ring::Color(255,82,30));
     
 }
-void NachAlarm() {
-  Serial.println("     Nach-Alarm!   ");
-  mp3.stop();
+void onAlarmPost() {
+  Serial.println(F("     Nach-Alarm!   "));
+  if (alarmPlaylist) mp3.stop();   // not isPlaying(), the BUSY pin lags behind play() or is not wired
+  alarmPlaylist = false;
   // Licht aus und Musik aus
   ledring.Off();
+#ifdef WECKER_WALL
+  wall.Off();
+#endif
     
 }
-void VorAlarm() {
-  Serial.println("     Vor-Alarm!   ");
+void onAlarmPre(uint16_t elapsed) {
+  Serial.println(F("     Vor-Alarm!   "));
   // Sonnenuntergang an
-  long interval = 1000 * (long)clock.getSecsBeforeAlarm() / 240;   // interval = milliseconds / totalSteps of pattern
-  Serial.print("Starte Sunrise mit intervall ");
-  Serial.println(interval); // 60s = 250; 120s = 500
-  ledring.Sunup(interval);
+  unsigned long duration = 1000 * (unsigned long)clock.getSecsBeforeAlarm();   // sunrise ends exactly at alarm time
+  Serial.print(F("Starte Sunrise mit Dauer "));
+  Serial.print(duration);
+  Serial.print(F(" ab "));
+  Serial.println(1000 * (unsigned long)elapsed);
+  ledring.Sunup(duration, SUN_FRAME_INTERVAL, 1000 * (unsigned long)elapsed);
+#ifdef WECKER_WALL
+  wall.Sunrise(duration, 1000 * (unsigned long)elapsed);
+#endif
 }
-// NeoPattern Callback
-void SunriseComplete() {
-  Serial.println("Completion Callback"); 
+void onPatternComplete(uint16_t completed) {
+  Serial.println(F("Completion Callback")); 
+  if (completed != ledring.ActivePattern) return;   // pattern was changed in the meantime
   // Licht umstellen auf Dauer-an
-  ledring.Steady(NeoPattern::Color(255,82,30));
+  ledring.Steady(Ring::Color(255,82,30));
+}
+
+//------------------------------------------------------------
+//Memory report - static size of every global object plus runtime usage
+//------------------------------------------------------------
+void memReport() {
+  MEM_FOOTPRINT(mfrc522);
+  MEM_FOOTPRINT(mp3);
+  MEM_FOOTPRINT(clock);
+  MEM_FOOTPRINT(ledring);
+  MEM_FOOTPRINT(trace);
+  MEM_FOOTPRINT(i2c);
+  MemStats::printEntry(F("ledring.pixels"), Board::LED_COUNT * 3);   // allocated on the heap by the constructor
+#ifdef WECKER_WALL
+  MEM_FOOTPRINT(wall);
+#endif
+#ifdef _SS_MAX_RX_BUFF
+  MemStats::printEntry(F("SoftwareSerial.rx"), _SS_MAX_RX_BUFF);
+#endif
+#ifdef SERIAL_RX_BUFFER_SIZE
+  MemStats::printEntry(F("Serial.rx+tx"), SERIAL_RX_BUFFER_SIZE + SERIAL_TX_BUFFER_SIZE);
+#endif
+#ifdef WECKER_BENCH
+  MEM_FOOTPRINT(bench);
+#endif
+  MemStats::report();
+}
+
+//------------------------------------------------------------
+//Benchmark - replay a scripted scenario on simulated time
+//------------------------------------------------------------
+#ifdef WECKER_BENCH
+Reader::nfcTagObject benchCard;
+
+void benchSetup(BenchScenario scenario) {
+  bench.begin(scenario, BENCH_STEP);
+  switch (scenario) {
+    case BENCH_NIGHT:
+      clock.SetAlarmTime(7, 0, 1800, 1800);
+      clock.enableAlarm();
+      break;
+    case BENCH_CARDSTORM:
+    case BENCH_PIXEL:
+      benchCard.id = 1;
+      benchCard.cookie = 322417480;
+      benchCard.wakeup_mode = WKMOD_ON;
+      benchCard.wakeup_sound = WSND_UNCHANGED;
+      benchCard.wakeup_hours = 7;
+      benchCard.wakeup_minutes = 0;
+      benchCard.light_pattern = PAT_OFF;
+      benchCard.light_r = 255;
+      benchCard.light_g = 82;
+      benchCard.light_b = 30;
+      break;
+    case BENCH_RAINBOW:
+      ledring.RainbowCycle(300);
+      break;
+    case BENCH_SUNRISE:
+      ledring.Sunup(1800000UL);
+      break;
+    case BENCH_WALL:
+#ifdef WECKER_WALL
+      benchWallSweep();
+      wall.Sunrise(1800000UL);
+#else
+      Serial.println(F("BENCH_WALL braucht WECKER_WALL"));
+#endif
+      break;
+  }
+}
+
+#ifdef WECKER_WALL
+// time of wall.show(n) in us, taken from timer1 (4 us ticks): show() runs
+// with interrupts off, so micros() would miss the timer0 overflows
+unsigned long wallShowMicros(uint16_t n) {
+  uint8_t a = TCCR1A;
+  uint8_t b = TCCR1B;
+  while (!wall.canShow());   // the latch of the previous frame is not part of it
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11) | _BV(CS10);   // normal mode, clk / 64
+  TCNT1 = 0;
+  wall.show(n);
+  uint16_t ticks = TCNT1;
+  TCCR1A = a;
+  TCCR1B = b;
+  return ticks * 4UL;
+}
+
+// RAM and show() time of the wall strip for growing pixel counts
+void benchWallSweep() {
+  Serial.println(F("wall,bits,pixels,ram,rgb_ram,show_us"));
+  wall.Sunrise(1);
+  wall.Update(0);
+  wall.Update(1);     // full brightness, every palette entry in use
+  for (uint16_t n = 8; ; n += (n < 32) ? n : 32) {
+    if (n > Board::WALL_COUNT) n = Board::WALL_COUNT;
+    unsigned long duration = wallShowMicros(n);
+    Serial.print(F("wall,"));
+    Serial.print(Wall::BITS_PER_PIXEL);
+    Serial.print(',');
+    Serial.print(n);
+    Serial.print(',');
+    Serial.print(Wall::ramBytes(n));
+    Serial.print(',');
+    Serial.print(n * 3);
+    Serial.print(',');
+    Serial.println(duration);
+    if (n == Board::WALL_COUNT) break;
+  }
+  wall.Off();
+}
+#endif
+
+void benchLoop() {
+  if (bench.done()) return;
+  bench.beginWork();
+
+  unsigned long ms = bench.millis();
+  if (bootStage != BOOT_DONE) bootStep();
+  mp3.loop();
+  i2c.nextSlot();
+  if (ms - lastClockUpdate >= CLOCK_INTERVAL) {
+    lastClockUpdate = ms;
+    DateTime now = clock.now();   // simulated time
+    trace.sync(now.secondstime(), ms);
+    clock.update(now);
+  }
+  if (!i2c.busy()) clock.drawSlice();
+  unsigned long lastFrame = ledring.lastUpdate;
+  bench.checkFrame(lastFrame, ledring.Interval, ledring.Running());
+  unsigned long frameStart = micros();
+  ledring.Update(ms);
+  bench.countFrame(lastFrame, ledring.lastUpdate, micros() - frameStart);
+#ifdef WECKER_WALL
+  wall.Update(ms);
+#endif
+
+  // the reader is polled as usual, card contents come from the scenario
+  if (ms - lastCardPoll >= CARD_INTERVAL && mfrc522.present) {
+    lastCardPoll = ms;
+    mfrc522.PICC_IsNewCardPresent();
+    BENCH_COUNT(spiBytes, BENCH_SPI_CARD_POLL);
+  }
+  if (bench.cardDue()) {
+    BENCH_COUNT(spiBytes, BENCH_SPI_CARD_READ);
+    // cycle through all patterns, or only the per-pixel ones
+    if (bench.scenario == BENCH_PIXEL) {
+      benchCard.light_pattern = (benchCard.light_pattern < PAT_SUNARC || benchCard.light_pattern >= PAT_BREATHE) ? PAT_SUNARC : benchCard.light_pattern + 1;
+    } else {
+      benchCard.light_pattern = (benchCard.light_pattern + 1) % (PAT_BREATHE + 1);
+    }
+    mfrc522.myCard = benchCard;
+    events.post(EV_CARD_READ, true);
+  }
+  dispatchEvents();
+  trace.loop(ms);
+
+  bench.endWork();
+  bench.step();
+  if (bench.done()) memReport();
 }
+#endif